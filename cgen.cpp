@@ -1471,25 +1471,90 @@ namespace clib {
         cycle.clear();
     }
 
-    std::vector<byte> cgen::file() const {
+    std::vector<byte> cgen::file(bool compact) const {
         std::vector<byte> file;
         auto entry = symbols[0].find("main");
         if (entry == symbols[0].end()) {
             error("main() not defined");
         }
+        auto code = compact ? pack(text) : std::vector<byte>((byte *) text.data(), (byte *) (text.data() + text.size()));
         auto magic = string_t(PE_MAGIC);
         std::copy((byte *) magic.data(), (byte *) magic.data() + magic.size(), std::back_inserter(file));
-        auto addr = std::dynamic_pointer_cast<sym_func_t>(entry->second)->addr;
+        auto addr = (uint) std::dynamic_pointer_cast<sym_func_t>(entry->second)->addr;
         std::copy((byte *) &addr, (byte *) &addr + sizeof(addr), std::back_inserter(file));
-        auto data_size = data.size() * sizeof(data[0]);
+        auto data_size = (uint) (data.size() * sizeof(data[0]));
         std::copy((byte *) &data_size, (byte *) &data_size + sizeof(data_size), std::back_inserter(file));
-        auto text_size = text.size() * sizeof(text[0]);
+        auto text_size = (uint) code.size();
         std::copy((byte *) &text_size, (byte *) &text_size + sizeof(text_size), std::back_inserter(file));
+        auto flags = (uint) (compact ? PE_COMPACT : 0);
+        std::copy((byte *) &flags, (byte *) &flags + sizeof(flags), std::back_inserter(file));
         std::copy(data.begin(), data.end(), std::back_inserter(file));
-        std::copy((byte *) text.data(), (byte *) text.data() + text_size, std::back_inserter(file));
+        std::copy(code.begin(), code.end(), std::back_inserter(file));
         return file;
     }
 
+    // 紧凑编码：操作码占一字节，操作数为zigzag变长整数，跳转目标存相对于本指令的字偏移
+    // 解码后与按字编码完全相同，代码地址（函数指针、跳转目标）仍以字为单位
+    std::vector<byte> cgen::pack(const std::vector<LEX_T(int)> &text) {
+        std::vector<byte> code;
+        auto put = [&](int v) {
+            auto u = ((uint32_t) v << 1) ^ (uint32_t) (v >> 31);
+            while (u >= 0x80) {
+                code.push_back((byte) (u | 0x80));
+                u >>= 7;
+            }
+            code.push_back((byte) u);
+        };
+        for (size_t i = 0; i < text.size();) {
+            auto op = text[i];
+            if (op < NOP || op > EXIT || i + INS_LEN((ins_t) op) > text.size())
+                throw cexception(ex_gen, "pack: invalid instruction");
+            code.push_back((byte) op);
+            if (op == JMP || op == JZ || op == JNZ)
+                put(text[i + 1] - (int) i);
+            else
+                for (auto j = 1; j < INS_LEN((ins_t) op); ++j)
+                    put(text[i + j]);
+            i += INS_LEN((ins_t) op);
+        }
+        return code;
+    }
+
+    bool cgen::unpack(const byte *p, uint32_t len, std::vector<uint32_t> &text) {
+        auto end = p + len;
+        auto get = [&](int &v) {
+            uint32_t u = 0;
+            for (auto shift = 0; shift < 35; shift += 7) {
+                if (p == end)
+                    return false;
+                auto b = *p++;
+                u |= (uint32_t) (b & 0x7f) << shift;
+                if (!(b & 0x80)) {
+                    v = (int) ((u >> 1) ^ (0U - (u & 1)));
+                    return true;
+                }
+            }
+            return false;
+        };
+        text.clear();
+        while (p < end) {
+            auto op = (int) *p++;
+            if (op > EXIT)
+                return false;
+            auto i = (int) text.size();
+            text.push_back((uint32_t) op);
+            for (auto j = 1; j < INS_LEN((ins_t) op); ++j) {
+                int v;
+                if (!get(v))
+                    return false;
+                if (op == JMP || op == JZ || op == JNZ)
+                    v += i;
+                text.push_back((uint32_t) v);
+            }
+        }
+        return true;
+    }
+
     void cgen::emit(ins_t i) {
 #if LOG_TYPE
         std::cout << "[DEBUG] *GEN* ==> [" << setiosflags(std::ios::right)
@@ -2928,7 +2993,7 @@ namespace clib {
                     if (delta > 0) {
                         emit(PUSH, cast_size(t_ptr));
                         emit(IMM, delta);
-                        emit(ADD);
+                        emit(ADD, t_ptr);
                     }
                     if (type->get_cast() != init->get_cast())
                         error(init, "allocate: not equal init type");
@@ -336,11 +336,15 @@ namespace clib {
         int addr;
     };
 
+/* 代码段为紧凑编码：单字节操作码，变长操作数，跳转为相对偏移 */
+#define PE_COMPACT 0x1
+
     struct PE {
         char magic[4];
         uint entry;
         uint data_len;
-        uint text_len;
+        uint text_len; // 代码段字节数（按编码方式）
+        uint flags;
         byte data;
         // byte *data;
         // byte *text;
@@ -359,7 +363,9 @@ namespace clib {
 
         void gen(ast_node *node);
         void reset();
-        std::vector<byte> file() const;
+        std::vector<byte> file(bool compact = true) const;
+        static std::vector<byte> pack(const std::vector<LEX_T(int)> &text);
+        static bool unpack(const byte *p, uint32_t len, std::vector<uint32_t> &text);
 
         void emit(ins_t) override;
         void emit(ins_t, int) override;
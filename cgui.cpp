@@ -668,6 +668,8 @@ namespace clib {
                 cvm::global_state.input_content.clear();
                 cvm::global_state.input_read_ptr = 0;
                 cvm::global_state.input_success = true;
+                if (vm)
+                    vm->input_wake();
                 input_state = false;
             }
             return;
@@ -690,6 +692,8 @@ namespace clib {
             cvm::global_state.input_content = input_buffer();
             cvm::global_state.input_read_ptr = 0;
             cvm::global_state.input_success = true;
+            if (vm)
+                vm->input_wake();
             input_state = false;
             return;
         }
@@ -764,6 +768,8 @@ namespace clib {
             cvm::global_state.input_content.push_back(C);
             cvm::global_state.input_read_ptr = 0;
             cvm::global_state.input_success = true;
+            if (vm)
+                vm->input_wake();
             input_state = false;
             auto begin = ptr_mx + ptr_my * cols;
             auto end = ptr_x + ptr_y * cols;
@@ -0,0 +1,372 @@
+//
+// Project: clibparser
+// Created by bajdcc
+//
+
+#include <cstring>
+#include <deque>
+#include "cjit.h"
+
+#if CVM_JIT
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+#define INC_PTR 4
+
+namespace clib {
+
+    cjit::cjit() = default;
+
+    cjit::~cjit() {
+#if CVM_JIT
+        for (auto &c : chunks) {
+#if defined(_WIN32)
+            VirtualFree(c, 0, MEM_RELEASE);
+#else
+            munmap(c, JIT_CHUNK_SIZE);
+#endif
+        }
+#endif
+    }
+
+    bool cjit::available() {
+        return CVM_JIT != 0;
+    }
+
+    bool cjit::has(uint32_t idx) const {
+        return idx < entries.size() && entries[idx];
+    }
+
+    size_t cjit::code_size() const {
+        return total;
+    }
+
+    byte *cjit::alloc(size_t size) {
+#if CVM_JIT
+        size = (size + 15U) & ~15U;
+        if (size > JIT_CHUNK_SIZE)
+            return nullptr;
+        if (chunks.empty() || chunk_used + size > JIT_CHUNK_SIZE) {
+#if defined(_WIN32)
+            auto c = (byte *) VirtualAlloc(nullptr, JIT_CHUNK_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+            if (!c)
+                return nullptr;
+#else
+            auto c = (byte *) mmap(nullptr, JIT_CHUNK_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (c == MAP_FAILED)
+                return nullptr;
+#endif
+            chunks.push_back(c);
+            chunk_used = 0;
+        }
+        auto p = chunks.back() + chunk_used;
+        chunk_used += size;
+        total += size;
+        return p;
+#else
+        return nullptr;
+#endif
+    }
+
+    int cjit::enter(void *ctx, uint32_t idx, int budget) const {
+        return trampoline(ctx, entries[idx], budget);
+    }
+
+#if CVM_JIT
+    // 机器码缓冲区，跳转目标统一用rel32回填
+    class jit_emitter {
+    public:
+        void b(byte v) { buf.push_back(v); }
+        void bs(std::initializer_list<byte> v) { buf.insert(buf.end(), v); }
+        void d(uint32_t v) { for (int i = 0; i < 4; ++i) buf.push_back((byte) (v >> (i * 8))); }
+        void q(uint64 v) { for (int i = 0; i < 8; ++i) buf.push_back((byte) (v >> (i * 8))); }
+        size_t pos() const { return buf.size(); }
+
+        // 写入rel32占位，稍后按标签回填
+        void rel(int label) {
+            fixups.emplace_back(buf.size(), label);
+            d(0);
+        }
+
+        int new_label() {
+            labels.push_back(-1);
+            return (int) labels.size() - 1;
+        }
+
+        void bind(int label) { labels[label] = (int) buf.size(); }
+        int offset(int label) const { return labels[label]; }
+
+        void finish() {
+            for (auto &f : fixups) {
+                auto target = labels[f.second];
+                auto v = (uint32_t) (target - (int) (f.first + 4));
+                std::memcpy(&buf[f.first], &v, 4);
+            }
+        }
+
+        // mov dword [rbx+disp32], imm32
+        void mov_m_i(int disp, uint32_t imm) { bs({0xC7, 0x83}); d((uint32_t) disp); d(imm); }
+        // mov eax, [rbx+disp32]
+        void mov_eax_m(int disp) { bs({0x8B, 0x83}); d((uint32_t) disp); }
+        // mov [rbx+disp32], eax
+        void mov_m_eax(int disp) { bs({0x89, 0x83}); d((uint32_t) disp); }
+        // PC = 基址 + 偏移：mov eax, [rbx+base]; add eax, imm32; mov [rbx+pc], eax
+        void set_pc(int off_pc, int off_base, uint32_t offset) {
+            mov_eax_m(off_base);
+            b(0x05);
+            d(offset);
+            mov_m_eax(off_pc);
+        }
+        // add dword [rbx+disp32], imm32
+        void add_m_i(int disp, uint32_t imm) { bs({0x81, 0x83}); d((uint32_t) disp); d(imm); }
+        // cmp dword [rbx+disp32], 0
+        void cmp_m_0(int disp) { bs({0x83, 0xBB}); d((uint32_t) disp); b(0); }
+        // jmp/je/jne/jl rel32
+        void jmp(int label) { b(0xE9); rel(label); }
+        void je(int label) { bs({0x0F, 0x84}); rel(label); }
+        void jne(int label) { bs({0x0F, 0x85}); rel(label); }
+        void jl(int label) { bs({0x0F, 0x8C}); rel(label); }
+
+        // 调用辅助函数helper(vm, arg)，返回值在eax
+        void call(void *vm, int arg, jit_helper_t helper) {
+#if defined(_WIN32)
+            bs({0x48, 0xB9}); q((uint64) vm); // mov rcx, imm64
+            b(0xBA); d((uint32_t) arg); // mov edx, imm32
+#else
+            bs({0x48, 0xBF}); q((uint64) vm); // mov rdi, imm64
+            b(0xBE); d((uint32_t) arg); // mov esi, imm32
+#endif
+            bs({0x48, 0xB8}); q((uint64) helper); // mov rax, imm64
+            bs({0xFF, 0xD0}); // call rax
+            bs({0x85, 0xC0}); // test eax, eax
+        }
+
+        // 保存rbx/r12并对齐栈（含Win64影子空间），之后跳至目标
+        void prologue() {
+            b(0x53); // push rbx
+            bs({0x41, 0x54}); // push r12
+            bs({0x48, 0x83, 0xEC, 0x28}); // sub rsp, 40
+#if defined(_WIN32)
+            bs({0x48, 0x89, 0xCB}); // mov rbx, rcx
+            bs({0x45, 0x89, 0xC4}); // mov r12d, r8d
+            bs({0xFF, 0xE2}); // jmp rdx
+#else
+            bs({0x48, 0x89, 0xFB}); // mov rbx, rdi
+            bs({0x41, 0x89, 0xD4}); // mov r12d, edx
+            bs({0xFF, 0xE6}); // jmp rsi
+#endif
+        }
+
+        void epilogue() {
+            bs({0x44, 0x89, 0xE0}); // mov eax, r12d
+            bs({0x48, 0x83, 0xC4, 0x28}); // add rsp, 40
+            bs({0x41, 0x5C}); // pop r12
+            b(0x5B); // pop rbx
+            b(0xC3); // ret
+        }
+
+        std::vector<byte> buf;
+
+    private:
+        std::vector<int> labels;
+        std::vector<std::pair<size_t, int>> fixups;
+    };
+#endif
+
+    std::vector<uint32_t> cjit::compile(const jit_env_t &env, const std::vector<int> &text, uint32_t entry) {
+        std::vector<uint32_t> compiled;
+#if CVM_JIT
+        auto n = (uint32_t) text.size();
+        if (entry >= n)
+            return compiled;
+        if (!trampoline) {
+            jit_emitter e;
+            e.prologue();
+            auto p = alloc(e.buf.size());
+            if (!p)
+                return compiled;
+            std::memcpy(p, e.buf.data(), e.buf.size());
+            trampoline = (int (*)(void *, void *, int)) p;
+        }
+        if (entries.size() < n)
+            entries.resize(n, nullptr);
+        // 1. 沿控制流找出函数包含的指令
+        enum { K_NONE, K_NATIVE, K_BAIL };
+        std::vector<byte> kind(n, K_NONE);
+        std::vector<jit_helper_t> helpers(n, nullptr);
+        std::deque<uint32_t> work{entry};
+        auto count = 0;
+        auto in_range = [=](int t) { return t >= 0 && (uint32_t) t < n; };
+        auto visit = [&](int t) {
+            if (in_range(t))
+                work.push_back((uint32_t) t);
+        };
+        while (!work.empty()) {
+            auto i = work.front();
+            work.pop_front();
+            if (kind[i] != K_NONE)
+                continue;
+            if (++count > JIT_MAX_FUNC)
+                return compiled;
+            auto op = text[i];
+            if (op < NOP || op > EXIT || i + INS_LEN((ins_t) op) > n) {
+                kind[i] = K_BAIL;
+                continue;
+            }
+            auto next = i + INS_LEN((ins_t) op);
+            auto arg = i + 1 < n ? text[i + 1] : 0;
+            kind[i] = K_NATIVE;
+            switch (op) {
+                case NOP:
+                case IMM:
+                case IMX:
+                case LEA:
+                case ADJ:
+                    visit(next);
+                    break;
+                case JMP:
+                    visit(arg);
+                    break;
+                case JZ:
+                case JNZ:
+                    visit(arg);
+                    visit(next);
+                    break;
+                case EXIT:
+                    kind[i] = K_BAIL;
+                    break;
+                case INTR:
+                case CAST:
+                    kind[i] = K_BAIL;
+                    visit(next);
+                    break;
+                default:
+                    helpers[i] = env.resolve(op, arg);
+                    if (!helpers[i])
+                        kind[i] = K_BAIL;
+                    if (op != LEV)
+                        visit(next);
+                    break;
+            }
+        }
+        // 2. 按下标顺序生成代码
+        jit_emitter e;
+        auto epilogue = e.new_label();
+        std::vector<int> labels(n, -1);
+        std::vector<std::pair<int, uint32_t>> stub_pc;
+        auto label_of = [&](uint32_t i) {
+            if (labels[i] == -1)
+                labels[i] = e.new_label();
+            return labels[i];
+        };
+        // 退出桩：设置PC后返回解释器
+        auto exit_to = [&](int t) {
+            auto l = e.new_label();
+            stub_pc.emplace_back(l, (uint32_t) t * INC_PTR);
+            return l;
+        };
+        auto target_of = [&](int t) {
+            return in_range(t) && kind[t] != K_NONE ? label_of((uint32_t) t) : exit_to(t);
+        };
+        for (uint32_t i = 0; i < n; ++i) {
+            if (kind[i] == K_NONE)
+                continue;
+            e.bind(label_of(i));
+            auto pc = i * INC_PTR; // 相对基址的偏移
+            if (kind[i] == K_BAIL) {
+                e.set_pc(env.off_pc, env.off_base, pc);
+                e.jmp(epilogue);
+                continue;
+            }
+            auto op = text[i];
+            auto next = i + INS_LEN((ins_t) op);
+            auto arg1 = i + 1 < n ? text[i + 1] : 0;
+            auto arg2 = i + 2 < n ? text[i + 2] : 0;
+            e.bs({0x41, 0x83, 0xEC, 0x01}); // sub r12d, 1
+            auto here = exit_to((int) i);
+            e.jl(here);
+            auto fallthrough = true;
+            switch (op) {
+                case NOP:
+                    break;
+                case IMM:
+                    e.mov_m_i(env.off_ax, (uint32_t) arg1);
+                    break;
+                case IMX:
+                    e.mov_m_i(env.off_ax, (uint32_t) arg1);
+                    e.mov_m_i(env.off_ax + 4, (uint32_t) arg2);
+                    break;
+                case LEA:
+                    e.mov_eax_m(env.off_bp);
+                    e.b(0x05); // add eax, imm32
+                    e.d((uint32_t) arg1);
+                    e.mov_m_eax(env.off_ax);
+                    break;
+                case ADJ:
+                    e.add_m_i(env.off_sp, (uint32_t) arg1 * INC_PTR);
+                    break;
+                case JMP:
+                    e.jmp(target_of(arg1));
+                    fallthrough = false;
+                    break;
+                case JZ:
+                    e.cmp_m_0(env.off_ax);
+                    e.je(target_of(arg1));
+                    break;
+                case JNZ:
+                    e.cmp_m_0(env.off_ax);
+                    e.jne(target_of(arg1));
+                    break;
+                case CALL:
+                    // 辅助函数压入返回地址（传入偏移）并设置PC，回到调度器查找被调函数
+                    e.call(env.vm, (int) (pc + INC_PTR), helpers[i]);
+                    e.jne(here);
+                    e.jmp(epilogue);
+                    fallthrough = false;
+                    break;
+                case LEV:
+                    e.call(env.vm, arg1, helpers[i]);
+                    e.jne(here);
+                    e.jmp(epilogue);
+                    fallthrough = false;
+                    break;
+                default:
+                    e.call(env.vm, arg1, helpers[i]);
+                    e.jne(here);
+                    break;
+            }
+            if (fallthrough) {
+                auto j = i + 1;
+                while (j < n && kind[j] == K_NONE)
+                    j++;
+                if (j != next)
+                    e.jmp(target_of((int) next));
+            }
+            compiled.push_back(i);
+        }
+        for (auto &s : stub_pc) {
+            e.bind(s.first);
+            e.set_pc(env.off_pc, env.off_base, s.second);
+            e.jmp(epilogue);
+        }
+        e.bind(epilogue);
+        e.epilogue();
+        e.finish();
+        auto p = alloc(e.buf.size());
+        if (!p) {
+            compiled.clear();
+            return compiled;
+        }
+        std::memcpy(p, e.buf.data(), e.buf.size());
+        for (auto &i : compiled) {
+            entries[i] = p + e.offset(labels[i]);
+        }
+#endif
+        return compiled;
+    }
+}
@@ -0,0 +1,77 @@
+//
+// Project: clibparser
+// Created by bajdcc
+//
+
+#ifndef CLIBPARSER_CJIT_H
+#define CLIBPARSER_CJIT_H
+
+#include <vector>
+#include "types.h"
+
+/* 仅x86-64宿主生成本地代码，其余平台编译恒失败，只用解释器 */
+#if defined(__x86_64__) || defined(_M_X64)
+#define CVM_JIT 1
+#else
+#define CVM_JIT 0
+#endif
+
+/* 函数入口调用次数达到阈值后编译 */
+#define JIT_THRESHOLD 64
+/* 单个函数最多编译的代码字数 */
+#define JIT_MAX_FUNC 8192
+/* 可执行内存块大小 */
+#define JIT_CHUNK_SIZE (64 * 1024)
+
+namespace clib {
+
+    // 辅助函数：第一个参数为虚拟机，返回非零表示发生异常
+    typedef int (*jit_helper_t)(void *vm, int arg);
+
+    // 编译环境（由虚拟机提供）
+    struct jit_env_t {
+        void *vm; // 传给辅助函数
+        int off_ax; // 寄存器在进程上下文中的偏移
+        int off_sp;
+        int off_bp;
+        int off_pc;
+        int off_base; // 代码段基址（本地代码与进程无关，可跨进程共享）
+        // 按操作码和操作数查找辅助函数，不支持的返回空，交给解释器
+        jit_helper_t (*resolve)(int op, int arg);
+    };
+
+    // 模板式基线编译器：每条指令对应一段固定的机器码
+    // 寄存器：rbx = 进程上下文，r12d = 剩余指令数
+    // 简单指令（立即数、取址、跳转、栈调整）直接生成，其余调用辅助函数
+    // 遇到中断、类型转换等指令时退出本地代码，由解释器执行后再进入
+    class cjit {
+    public:
+        cjit();
+        ~cjit();
+
+        cjit(const cjit &) = delete;
+        cjit &operator=(const cjit &) = delete;
+
+        static bool available();
+
+        // 编译从entry开始的函数，返回已编译的指令下标（失败则为空）
+        // 生成的代码只含相对代码段基址的偏移，同一映像的所有进程可共用
+        std::vector<uint32_t> compile(const jit_env_t &env, const std::vector<int> &text, uint32_t entry);
+        // 从下标idx处进入本地代码，返回剩余指令数（小于零表示时间片用完）
+        int enter(void *ctx, uint32_t idx, int budget) const;
+        bool has(uint32_t idx) const;
+        size_t code_size() const;
+
+    private:
+        byte *alloc(size_t size);
+
+    private:
+        std::vector<byte *> chunks;
+        size_t chunk_used{0};
+        size_t total{0};
+        std::vector<byte *> entries;
+        int (*trampoline)(void *ctx, void *target, int budget){nullptr};
+    };
+}
+
+#endif //CLIBPARSER_CJIT_H
@@ -4,6 +4,7 @@
 //
 
 #include <algorithm>
+#include <chrono>
 #include "cmem.h"
 #include "cvm.h"
 #include "cexception.h"
@@ -12,190 +13,314 @@
 
 namespace clib {
 
-    cmem::cmem(imem *m) : m(m) { }
+    // 小对象大小类（8字节对齐）
+    static const uint32_t class_size[MEM_CLASS_NUM] = {
+        8, 16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 2048
+    };
 
-    static uint32_t size_align(uint32_t size) {
-        return (size + 3U) & ~3U;
+    // 按8字节单位查大小类
+    struct class_table_t {
+        std::array<uint8_t, MEM_SMALL_MAX / 8 + 1> index;
+
+        class_table_t() {
+            auto cls = 0;
+            for (uint32_t i = 0; i < index.size(); ++i) {
+                while (class_size[cls] < i * 8)
+                    cls++;
+                index[i] = (uint8_t) cls;
+            }
+        }
+    };
+
+    static const class_table_t class_table;
+
+    cmem::cmem(imem *m) : m(m) {
+        partial.fill(-1);
     }
 
     uint32_t cmem::alloc(uint32_t size) {
 #if LOG_MEM
         printf("[SYSTEM] MEM  | # ALLOC: %08X\n", size);
 #endif
-        size = size_align(size);
-        if (available_size < size) {
-            return new_page_all(size);
-        }
-        for (auto &f : memory_free) {
-            if (f.second >= size) {
-                auto free_addr = f.first;
-                auto free_size = f.second;
-                available_size -= size;
-                memory_free.erase(free_addr);
-                memory_used.insert(std::make_pair(free_addr, size));
-                if (size < free_size)
-                    memory_free.insert(std::make_pair(free_addr + size, free_size - size));
+        auto start = std::chrono::steady_clock::now();
+        if (size == 0)
+            size = 1;
+        auto addr = size <= MEM_SMALL_MAX ?
+                    alloc_small(class_table.index[(size + 7) / 8]) :
+                    alloc_large((uint32_t) PAGE_ALIGN_UP(size) / PAGE_SIZE);
+        stats.alloc_count++;
+        stats.alloc_ns += (uint64) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
 #if LOG_MEM
-                printf("[SYSTEM] MEM  | # ALLOC ==> %08X\n", free_addr);
-                dump();
+        printf("[SYSTEM] MEM  | # ALLOC ==> %08X\n", addr);
+        dump();
 #endif
-                return free_addr;
-            }
-        }
-        return new_page_all(size);
+        return addr;
     }
 
     uint32_t cmem::free(uint32_t addr) {
 #if LOG_MEM
         printf("[SYSTEM] MEM  | # FREE: %08X\n", addr);
 #endif
-        auto f = memory_used.find(addr);
-        if (f == memory_used.end()) {
+        auto start = std::chrono::steady_clock::now();
+        auto id = addr / PAGE_SIZE;
+        if (id >= pages.size()) {
             error("double free");
             return 0;
         }
-        auto used_addr = f->first;
-        auto used_size = f->second;
-        available_size += used_size;
-        auto prev_flag = true;
-        auto prev_addr = 0U;
-        auto prev_size = 0U;
-        auto next_flag = true;
-        auto next_addr = 0U;
-        auto next_size = 0U;
-        if (f != memory_used.begin()) {
-            f--;
-            if (f->first + f->second == used_addr) {
-                prev_flag = false;
-                prev_addr = f->first;
-                prev_size = f->second;
-            }
-            f++;
-        }
-        if (prev_flag) {
-            if (f == memory_used.begin()) {
-                auto first = memory_free.begin();
-                if (first->first + first->second == used_addr) {
-                    prev_addr = first->first;
-                    prev_size = first->second;
-                } else {
-                    prev_flag = false;
-                }
-            } else {
-                prev_flag = false;
-                for (auto &r : memory_free) {
-                    if (prev_addr + prev_size == used_addr) {
-                        prev_flag = true;
-                        prev_addr = r.first;
-                        prev_size = r.second;
-                    } else if (prev_addr + prev_size > used_addr) {
-                        break;
-                    }
+        uint32_t size = 0;
+        switch (pages[id].state) {
+            case PAGE_SMALL:
+                size = free_small(id, addr);
+                break;
+            case PAGE_LARGE:
+                size = free_large(id, addr);
+                break;
+            default:
+                error("double free");
+                break;
+        }
+        stats.free_count++;
+        stats.free_ns += (uint64) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+#if LOG_MEM
+        dump();
+#endif
+        return size;
+    }
+
+    // 小对象：新大小仍在原大小类之内
+    // 大对象：缩小时归还尾部页，增大时占用紧随其后的空闲页段，或在堆末尾扩展
+    bool cmem::resize(uint32_t addr, uint32_t size) {
+        auto id = addr / PAGE_SIZE;
+        auto old = size_of(addr);
+        stats.resize_count++;
+        if (size <= old && (pages[id].state == PAGE_SMALL || size > MEM_SMALL_MAX)) {
+            if (pages[id].state == PAGE_LARGE) {
+                auto n = (uint32_t) PAGE_ALIGN_UP(size) / PAGE_SIZE;
+                auto m = pages[id].run;
+                if (n < m) {
+                    pages[id].run = n;
+                    free_run(id + n, m - n);
                 }
             }
+            stats.resize_inplace++;
+            return true;
         }
-        if (f != memory_used.end()) {
-            f++;
-            if (used_addr + used_size == f->first) {
-                next_flag = false;
+        if (pages[id].state != PAGE_LARGE || size <= old)
+            return false;
+        auto m = pages[id].run;
+        auto n = (uint32_t) PAGE_ALIGN_UP(size) / PAGE_SIZE;
+        auto end = id + m;
+        if (end == pages.size()) {
+            if (id + n > MAX_PAGE_PER_PROCESS)
+                return false;
+            while (pages.size() < id + n) {
+                new_page_single();
             }
-            f--;
-        }
-        if (next_flag) {
-            auto f2 = memory_free.lower_bound(used_addr + used_size);
-            if (f2 == memory_free.end()) {
-                next_flag = false;
-            } else {
-                next_addr = f2->first;
-                next_size = f2->second;
-            }
-        }
-        if (prev_flag) {
-            if (next_flag) {
-                // [prev:free] [current:free] [next:free]
-                memory_free.erase(prev_addr);
-                memory_used.erase(used_addr);
-                memory_free.erase(next_addr);
-                memory_free.insert(std::make_pair(prev_addr, prev_size + used_size + next_size));
-            } else {
-                // [prev:free] [current:free] [next:used]
-                memory_free.erase(prev_addr);
-                memory_used.erase(used_addr);
-                memory_free.insert(std::make_pair(prev_addr, prev_size + used_size));
+        } else if (pages[end].state == PAGE_FREE && pages[end].run >= n - m) {
+            auto len = pages[end].run;
+            runs.erase(std::make_pair(len, end));
+            if (len > n - m) {
+                set_run(id + n, len - (n - m));
+                runs.insert(std::make_pair(len - (n - m), id + n));
             }
         } else {
-            if (next_size) {
-                // [prev:used] [current:free] [next:free]
-                memory_used.erase(used_addr);
-                memory_free.erase(next_addr);
-                memory_free.insert(std::make_pair(used_addr, used_size + next_size));
-            } else {
-                // [prev:used] [current:free] [next:used]
-                memory_used.erase(used_addr);
-                memory_free.insert(std::make_pair(used_addr, used_size));
+            return false;
+        }
+        for (auto i = end; i < id + n; ++i) {
+            pages[i].state = PAGE_TAIL;
+        }
+        pages[id].run = n;
+        stats.resize_inplace++;
+        return true;
+    }
+
+    uint32_t cmem::size_of(uint32_t addr) const {
+        auto id = addr / PAGE_SIZE;
+        if (id < pages.size()) {
+            auto &page = pages[id];
+            if (page.state == PAGE_SMALL) {
+                auto size = class_size[page.cls];
+                auto offset = OFFSET_INDEX(addr);
+                if (offset % size == 0 && page.bits.test(offset / size))
+                    return size;
+            } else if (page.state == PAGE_LARGE && OFFSET_INDEX(addr) == 0) {
+                return page.run * PAGE_SIZE;
             }
         }
-#if LOG_MEM
-        dump();
-#endif
-        return used_size;
+        error("invalid block");
+        return 0;
     }
 
     int cmem::page_size() const {
-        return (int) memory.size();
+        return (int) pages.size();
     }
 
-    uint32_t cmem::new_page(uint32_t size) {
-        auto id = memory.size();
-        while (size > 0) {
-            new_page_single();
-            if (size < PAGE_SIZE)
-                break;
-            size -= PAGE_SIZE;
+    const cmem::stat_t &cmem::stat() const {
+        return stats;
+    }
+
+    // 取该类有空闲块的页，没有则新开一页并切成等大的块
+    uint32_t cmem::alloc_small(int cls) {
+        auto size = class_size[cls];
+        if (partial[cls] == -1) {
+            auto id = new_run(1);
+            auto &page = pages[id];
+            auto n = PAGE_SIZE / size;
+            page.state = PAGE_SMALL;
+            page.cls = cls;
+            page.used = 0;
+            page.bits.reset();
+            page.slots.resize(n);
+            for (uint32_t i = 0; i < n; ++i) {
+                page.slots[i] = (uint16_t) (n - 1 - i); // 低地址的块先分配
+            }
+            link(id);
+        }
+        auto id = (uint32_t) partial[cls];
+        auto &page = pages[id];
+        auto slot = page.slots.back();
+        page.slots.pop_back();
+        page.bits.set(slot);
+        page.used++;
+        if (page.slots.empty())
+            unlink(id);
+        return id * PAGE_SIZE + slot * size;
+    }
+
+    uint32_t cmem::alloc_large(uint32_t n) {
+        auto start = new_run(n);
+        pages[start].state = PAGE_LARGE;
+        pages[start].run = n;
+        for (uint32_t i = 1; i < n; ++i) {
+            pages[start + i].state = PAGE_TAIL;
+        }
+        return start * PAGE_SIZE;
+    }
+
+    // 页内的块全部空闲时，若该类还有别的空闲页，则归还此页
+    uint32_t cmem::free_small(uint32_t id, uint32_t addr) {
+        auto &page = pages[id];
+        auto size = class_size[page.cls];
+        auto offset = OFFSET_INDEX(addr);
+        auto slot = offset / size;
+        if (offset % size != 0 || !page.bits.test(slot)) {
+            error("double free");
+            return 0;
+        }
+        page.bits.reset(slot);
+        page.slots.push_back((uint16_t) slot);
+        page.used--;
+        if (page.slots.size() == 1)
+            link(id);
+        if (page.used == 0 && (partial[page.cls] != (int) id || page.next != -1)) {
+            unlink(id);
+            std::vector<uint16_t>().swap(page.slots);
+            free_run(id, 1);
+        }
+        return size;
+    }
+
+    uint32_t cmem::free_large(uint32_t id, uint32_t addr) {
+        if (OFFSET_INDEX(addr) != 0) {
+            error("double free");
+            return 0;
         }
-        return id * PAGE_SIZE;
+        auto n = pages[id].run;
+        free_run(id, n);
+        return n * PAGE_SIZE;
     }
 
-    uint32_t cmem::new_page_single() {
-        if (memory.size() >= MAX_PAGE_PER_PROCESS) {
+    // 取连续n页：最佳适配空闲页段，没有则在末尾扩展
+    uint32_t cmem::new_run(uint32_t n) {
+        auto r = runs.lower_bound(std::make_pair(n, 0U));
+        if (r != runs.end()) {
+            auto len = r->first;
+            auto start = r->second;
+            runs.erase(r);
+            if (len > n) {
+                set_run(start + n, len - n);
+                runs.insert(std::make_pair(len - n, start + n));
+            }
+            return start;
+        }
+        auto start = (uint32_t) pages.size();
+        if (start + n > MAX_PAGE_PER_PROCESS) {
             error("exceed max page per process");
         }
-        available_size += PAGE_SIZE;
-        memory.emplace_back();
-        memory.back().resize(PAGE_SIZE * 2);
-        auto page_addr = PAGE_ALIGN_UP((uint32) memory.back().data());
-        memory_page.push_back(page_addr);
-        auto id = memory.size() - 1;
-        m->map_page(page_addr, id);
-        return id * PAGE_SIZE;
-    }
-
-    uint32_t cmem::new_page_all(uint32_t size) {
-        auto page = new_page(size);
-        available_size -= size;
-        memory_used.insert(std::make_pair(page, size));
-        if (OFFSET_INDEX(size)) {
-            memory_free.insert(
-                std::make_pair(page + size,
-                               (memory.size() * PAGE_SIZE - page) - OFFSET_INDEX(size)));
+        while (pages.size() < start + n) {
+            new_page_single();
         }
-#if LOG_MEM
-        printf("[SYSTEM] MEM  | # ALLOC ==> %08X\n", page);
-        dump();
-#endif
-        return page;
+        return start;
+    }
+
+    // 归还页段，物理页交还虚拟机，按边界标记与前后相邻的空闲页段合并，位于末尾则收缩
+    void cmem::free_run(uint32_t start, uint32_t n) {
+        for (uint32_t i = 0; i < n; ++i) {
+            pages[start + i].state = PAGE_FREE;
+            m->unmap_page(start + i);
+        }
+        if (start > 0 && pages[start - 1].state == PAGE_FREE) {
+            auto len = pages[start - 1].run;
+            start -= len;
+            n += len;
+            runs.erase(std::make_pair(len, start));
+        }
+        auto end = start + n;
+        if (end == pages.size()) {
+            pages.resize(start);
+            return;
+        }
+        if (pages[end].state == PAGE_FREE) {
+            auto len = pages[end].run;
+            runs.erase(std::make_pair(len, end));
+            n += len;
+        }
+        set_run(start, n);
+        runs.insert(std::make_pair(n, start));
     }
 
+    void cmem::set_run(uint32_t start, uint32_t n) {
+        pages[start].run = n;
+        pages[start + n - 1].run = n;
+    }
+
+    void cmem::link(uint32_t id) {
+        auto &page = pages[id];
+        auto &head = partial[page.cls];
+        page.prev = -1;
+        page.next = head;
+        if (head != -1)
+            pages[head].prev = (int) id;
+        head = (int) id;
+    }
+
+    void cmem::unlink(uint32_t id) {
+        auto &page = pages[id];
+        if (page.prev != -1)
+            pages[page.prev].next = page.next;
+        else
+            partial[page.cls] = page.next;
+        if (page.next != -1)
+            pages[page.next].prev = page.prev;
+        page.prev = page.next = -1;
+    }
+
+    // 只占用虚拟页，物理页在首次访问时由虚拟机映射
+    void cmem::new_page_single() {
+        if (pages.size() >= MAX_PAGE_PER_PROCESS) {
+            error("exceed max page per process");
+        }
+        pages.emplace_back();
+    }
+
+    // 只复制分配信息，页面由虚拟机在fork时共享映射
     void cmem::copy_from(const cmem &mem) {
-        available_size = mem.available_size;
         m = mem.m;
-        memory = mem.memory;
-        for (uint32_t i = 0; i < memory.size(); ++i) {
-            memory_page.push_back(PAGE_ALIGN_UP((uint32_t) memory[i].data()));
-            m->map_page(memory_page.back(), i);
-        }
-        memory_free = mem.memory_free;
-        memory_used = mem.memory_used;
+        pages = mem.pages;
+        partial = mem.partial;
+        runs = mem.runs;
     }
 
     void cmem::error(const string_t &str) const {
@@ -203,47 +328,44 @@ namespace clib {
     }
 
     void cmem::dump() const {
+        static const char *state[] = {"FREE", "SMALL", "LARGE", "TAIL"};
         printf("[SYSTEM] MEM  | >>> LOG\n");
-        printf("[SYSTEM] MEM  | PAGE: %d, FREE: %d\n", memory_page.size(), available_size);
-        for (auto &f : memory_free) {
-            printf("[SYSTEM] MEM  | FREE: %08X, SIZE: %08X\n", f.first, f.second);
-        }
-        for (auto &f : memory_used) {
-            printf("[SYSTEM] MEM  | USED: %08X, SIZE: %08X\n", f.first, f.second);
+        printf("[SYSTEM] MEM  | PAGE: %d, FREE RUNS: %d\n", (int) pages.size(), (int) runs.size());
+        for (uint32_t i = 0; i < pages.size(); ++i) {
+            auto &p = pages[i];
+            if (p.state == PAGE_SMALL)
+                printf("[SYSTEM] MEM  | %08X %-5s SIZE: %d, USED: %d\n", i * PAGE_SIZE, state[p.state],
+                       class_size[p.cls], p.used);
+            else
+                printf("[SYSTEM] MEM  | %08X %-5s RUN: %d\n", i * PAGE_SIZE, state[p.state], p.run);
         }
         printf("[SYSTEM] MEM  | <<< LOG\n");
         check();
     }
 
     void cmem::check() const {
-        auto all = memory_page.size() * PAGE_SIZE;
-        auto used = all - available_size;
-        auto u = 0U, f = 0U;
-        for (auto &a : memory_used) {
-            u += a.second;
-        }
-        for (auto &a : memory_free) {
-            f += a.second;
-        }
-        if (used != u) {
-            error("mem check failed: used");
-        }
-        if (available_size != f) {
-            error("mem check failed: free");
-        }
-        for (auto i = 0U; i < all;) {
-            auto f1 = memory_used.find(i);
-            if (f1 != memory_used.end()) {
-                i += f1->second;
-                continue;
+        auto free_pages = 0U;
+        for (auto &r : runs) {
+            if (pages[r.second].run != r.first || pages[r.second + r.first - 1].run != r.first)
+                error("mem check failed: run");
+            for (auto i = r.second; i < r.second + r.first; ++i) {
+                if (pages[i].state != PAGE_FREE)
+                    error("mem check failed: run");
             }
-            auto f2 = memory_free.find(i);
-            if (f2 != memory_free.end()) {
-                i += f2->second;
-                continue;
+            free_pages += r.first;
+        }
+        if (!pages.empty() && pages.back().state == PAGE_FREE)
+            error("mem check failed: tail");
+        for (uint32_t i = 0; i < pages.size(); ++i) {
+            auto &p = pages[i];
+            if (p.state == PAGE_FREE) {
+                free_pages--;
+            } else if (p.state == PAGE_SMALL) {
+                if (p.used + p.slots.size() != PAGE_SIZE / class_size[p.cls] || p.used != p.bits.count())
+                    error("mem check failed: used");
             }
-            printf("[SYSTEM] MEM  | Invalid addr: %08X\n", i);
-            error("mem check failed: addr");
         }
+        if (free_pages != 0)
+            error("mem check failed: free");
     }
-}
\ No newline at end of file
+}
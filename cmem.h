@@ -7,18 +7,32 @@
 #define CLIBPARSER_CMEM_H
 
 #include <vector>
-#include <map>
+#include <array>
+#include <set>
+#include <bitset>
 #include "types.h"
 
-#define MAX_PAGE_PER_PROCESS 64
+/* 堆的虚拟页数上限（240MB），页面首次访问时才映射 */
+#define MAX_PAGE_PER_PROCESS (60 * 1024)
+/* 小对象上限，更大的按整页分配 */
+#define MEM_SMALL_MAX 2048
+/* 小对象大小类数 */
+#define MEM_CLASS_NUM 15
+/* 每页最多的小对象块数（4KB / 8B） */
+#define MEM_SLOT_MAX 512
 
 namespace clib {
 
     class imem {
     public:
-        virtual void map_page(uint32_t addr, uint32_t id) = 0;
+        // 归还堆的第id页（若已映射）
+        virtual void unmap_page(uint32_t id) = 0;
     };
 
+    // 堆分配器：小对象按大小类分页存放，每页只放一类，空闲块O(1)存取
+    // 大对象按整页分配，空闲页段首尾页记录长度（边界标记），释放时O(1)与相邻页段合并
+    // 分配信息保存在宿主内存中，不占用虚拟机的堆；页面由虚拟机按需映射，整页空闲即归还
+    // 末尾的空闲页段直接收缩
     class cmem {
     public:
         explicit cmem(imem *m);
@@ -28,25 +42,64 @@ namespace clib {
 
         uint32_t alloc(uint32_t size);
         uint32_t free(uint32_t addr);
+        // 原地调整已分配块的大小，成功返回真；失败时块不变，由调用者另行分配并复制
+        bool resize(uint32_t addr, uint32_t size);
+        // 已分配块的可用大小
+        uint32_t size_of(uint32_t addr) const;
         int page_size() const;
 
         void copy_from(const cmem &mem);
 
+        // 分配与释放的次数及累计耗时，原地调整的次数
+        struct stat_t {
+            uint64 alloc_count;
+            uint64 alloc_ns;
+            uint64 free_count;
+            uint64 free_ns;
+            uint64 resize_count;
+            uint64 resize_inplace;
+        };
+        const stat_t &stat() const;
+
     private:
-        uint32_t new_page(uint32_t size);
-        uint32_t new_page_single();
-        uint32_t new_page_all(uint32_t size);
+        enum page_state_t {
+            PAGE_FREE, // 空闲页段
+            PAGE_SMALL, // 小对象页
+            PAGE_LARGE, // 大对象首页
+            PAGE_TAIL, // 大对象其余页
+        };
+
+        struct page_t {
+            page_state_t state{PAGE_FREE};
+            int cls{0}; // 小对象页的大小类
+            uint32_t run{0}; // 空闲页段首尾页、大对象首页记录页数
+            uint32_t used{0}; // 小对象页已分配的块数
+            std::vector<uint16_t> slots; // 小对象页的空闲块号
+            std::bitset<MEM_SLOT_MAX> bits; // 小对象页已分配的块
+            int prev{-1}, next{-1}; // 同一大小类中有空闲块的页
+        };
+
+        uint32_t alloc_small(int cls);
+        uint32_t alloc_large(uint32_t n);
+        uint32_t free_small(uint32_t id, uint32_t addr);
+        uint32_t free_large(uint32_t id, uint32_t addr);
+
+        uint32_t new_run(uint32_t n);
+        void free_run(uint32_t start, uint32_t n);
+        void set_run(uint32_t start, uint32_t n);
+        void link(uint32_t id);
+        void unlink(uint32_t id);
+        void new_page_single();
 
         void error(const string_t &) const;
         void dump() const;
         void check() const;
 
     private:
-        std::vector<std::vector<byte>> memory;
-        std::vector<uint32_t> memory_page;
-        std::map<uint32_t, uint32_t> memory_free;
-        std::map<uint32_t, uint32_t> memory_used;
-        size_t available_size{0};
+        std::vector<page_t> pages; // 各页的分配信息，物理页由虚拟机管理（可能写时复制共享）
+        std::array<int, MEM_CLASS_NUM> partial; // 各大小类中有空闲块的页（链表头）
+        std::set<std::pair<uint32_t, uint32_t>> runs; // 空闲页段（页数，首页），最佳适配
+        stat_t stats{};
         imem *m{nullptr};
     };
 }
@@ -3,32 +3,41 @@
 #include "/include/string"
 #include "/include/memory"
 int write_file(int handle) {
-    int c, r;
-    int state = input_lock();
-    while ((c = input_valid()) != -1) {
-        r = write(handle, (char) input_char());
-        if (r < 0) {
-            switch (r) {
-                case -1:
-                    set_fg(240, 0, 0);
-                    put_string("[ERROR] File not exists.");
-                    restore_fg();
-                    break;
-                case -2:
-                    set_fg(240, 0, 0);
-                    put_string("[ERROR] Forbidden.");
-                    restore_fg();
-                    break;
-                case -3:
-                    set_fg(240, 0, 0);
-                    put_string("[ERROR] Invalid handle.");
-                    restore_fg();
-                    break;
-            }
-            break;
+    int c, r = 0;
+    if (input_state() == 0) {
+        char *buf = malloc(4096);
+        while ((c = input_read(buf, 4096)) > 0) {
+            r = write_block(handle, buf, c);
+            if (r < 0)
+                break;
+        }
+        free(buf);
+    } else {
+        int state = input_lock();
+        while ((c = input_valid()) != -1) {
+            r = write(handle, (char) input_char());
+            if (r < 0)
+                break;
         }
+        input_unlock();
+    }
+    switch (r) {
+        case -1:
+            set_fg(240, 0, 0);
+            put_string("[ERROR] File not exists.");
+            restore_fg();
+            break;
+        case -2:
+            set_fg(240, 0, 0);
+            put_string("[ERROR] Forbidden.");
+            restore_fg();
+            break;
+        case -3:
+            set_fg(240, 0, 0);
+            put_string("[ERROR] Invalid handle.");
+            restore_fg();
+            break;
     }
-    input_unlock();
     close(handle);
 }
 char *trim(char *text) {
@@ -1,16 +1,19 @@
 #include "/include/io"
 #include "/include/fs"
+#include "/include/memory"
 int read_file(int handle) {
     int c;
-    while (c = read(handle), c < 0x1000) {
-        put_char(c);
+    char *buf = malloc(4096);
+    while (c = read_block(handle, buf, 4096), c > 0) {
+        put_buffer(buf, c);
     }
+    free(buf);
     switch (c) {
-        case -1:
+        case 0:
             // put_string("[INFO] Read to the end.");
             put_string("");
             break;
-        case -2:
+        case -1:
             set_fg(240, 0, 0);
             put_string("[ERROR] File already deleted.");
             restore_fg();
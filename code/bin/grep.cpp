@@ -16,10 +16,7 @@ string new_string() {
 void append_char(string *s, char c) {
     if (s->length >= s->capacity - 1) {
         s->capacity <<= 1;
-        char *new_text = malloc(s->capacity);
-        strcpy(new_text, s->text);
-        free(s->text);
-        s->text = new_text;
+        s->text = realloc(s->text, s->capacity);
     }
     (s->text)[s->length++] = c;
     (s->text)[s->length] = 0;
@@ -56,37 +53,50 @@ int match(char *str, int slen, char *rep, int len, int *arr) {
     }
     return -1;
 }
+void clear_string(string *s) {
+    s->length = 0;
+    (s->text)[0] = 0;
+}
+// s为原样输出的行（含控制序列），s2为去掉控制序列后用于匹配的行
+void grep_char(string *s, string *s2, int *cmd, char *rep, int len, int *arr, char c) {
+    if (c == '\033') {
+        append_char(s, c);
+        *cmd = 1 - *cmd;
+    } else if (*cmd == 0) {
+        if (c == '\n') {
+            if (match(s2->text, s2->length, rep, len, arr) != -1) {
+                append_char(s, '\n');
+                put_buffer(s->text, s->length);
+            }
+            clear_string(s);
+            clear_string(s2);
+        } else {
+            append_char(s2, c);
+            append_char(s, c);
+        }
+    } else {
+        append_char(s, c);
+    }
+}
 void grep(char *rep) {
-    int c, cmd = 0;
+    int c, i, cmd = 0;
     string s = new_string();
     string s2 = new_string();
     int *arr = build_next(rep), len = strlen(rep);
-    input_lock();
-    while ((c = input_valid()) != -1) {
-        c = input_char();
-        if (((char) c) == '\033') {
-            append_char(&s, c);
-            cmd = 1 - cmd;
-        } else if (cmd == 0) {
-            if (((char) c) == '\n') {
-                if (match(s2.text, s2.length, rep, len, arr) != -1) {
-                    put_string(s.text);
-                    put_string("\n");
-                } else {
-                    free(s.text);
-                }
-                free(s2.text);
-                s = new_string();
-                s2 = new_string();
-            } else {
-                append_char(&s2, c);
-                append_char(&s, c);
-            }
-        } else {
-            append_char(&s, c);
+    if (input_state() == 0) {
+        char *buf = malloc(4096);
+        while ((c = input_read(buf, 4096)) > 0) {
+            for (i = 0; i < c; ++i)
+                grep_char(&s, &s2, &cmd, rep, len, arr, buf[i]);
+        }
+        free(buf);
+    } else {
+        input_lock();
+        while ((c = input_valid()) != -1) {
+            grep_char(&s, &s2, &cmd, rep, len, arr, (char) input_char());
         }
+        input_unlock();
     }
-    input_unlock();
 }
 int main(int argc, char **argv) {
     char *cmd = malloc(1024);
@@ -26,6 +26,7 @@ int main(int argc, char **argv) {
     put_string("    head            - show head content\n");
     put_string("    tail            - show tail content\n");
     put_string("    ps              - show process information\n");
+    put_string("    ins             - show instruction statistics\n");
     put_string("\nDIR ==> /usr\n");
     put_string("    test            - test all cases\n");
     put_string("    test_rec        - test recursion\n");
@@ -36,6 +37,7 @@ int main(int argc, char **argv) {
     put_string("    test_struct     - test struct and linked list\n");
     put_string("    test_xtoa       - test itoa/dtoa/atoi\n");
     put_string("    test_vector     - test vector\n");
+    put_string("    bench           - benchmark execution modes\n");
     put_string("    draw            - test draw function\n");
     put_string("    badapple        - test badapple animation\n");
     restore_fg();
@@ -1,7 +1,22 @@
 #include "/include/io"
+#include "/include/memory"
 char *hex = "0123456789ABCDEF";
 int pipe_x() {
-    int c;
+    int c, i;
+    if (input_state() == 0) {
+        char *buf = malloc(4096);
+        char *out = malloc(8192);
+        while ((c = input_read(buf, 4096)) > 0) {
+            for (i = 0; i < c; ++i) {
+                out[i * 2] = hex[(buf[i] >> 4) & 0xF];
+                out[i * 2 + 1] = hex[buf[i] & 0xF];
+            }
+            put_buffer(out, c * 2);
+        }
+        free(buf);
+        free(out);
+        return 0;
+    }
     input_lock();
     while ((c = input_valid()) != -1) {
         c = input_char();
@@ -1,6 +1,15 @@
 #include "/include/io"
+#include "/include/memory"
 int pipe() {
     int c;
+    if (input_state() == 0) {
+        char *buf = malloc(4096);
+        while ((c = input_read(buf, 4096)) > 0) {
+            put_buffer(buf, c);
+        }
+        free(buf);
+        return 0;
+    }
     input_lock();
     while ((c = input_valid()) != -1) {
         put_char((char) input_char());
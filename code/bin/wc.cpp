@@ -1,6 +1,20 @@
 #include "/include/io"
+#include "/include/fs"
+#include "/include/memory"
 int wc(int *lines, int *chars) {
-    int c;
+    int c, i;
+    if (input_state() == 0) {
+        char *buf = malloc(4096);
+        while ((c = input_read(buf, 4096)) > 0) {
+            (*chars) += c;
+            for (i = 0; i < c; ++i) {
+                if (buf[i] == '\n')
+                    (*lines)++;
+            }
+        }
+        free(buf);
+        return 0;
+    }
     input_lock();
     while ((c = input_valid()) != -1) {
         c = input_char();
@@ -11,10 +25,36 @@ int wc(int *lines, int *chars) {
     input_unlock();
     return 0;
 }
+int wc_file(char *path, int *lines, int *chars) {
+    int handle = open(path);
+    if (handle < 0)
+        return handle;
+    char *data = mmap(handle, 0);
+    char *s = data;
+    if (data) {
+        while (*s) {
+            if (*s++ == '\n')
+                (*lines)++;
+            (*chars)++;
+        }
+        munmap(data);
+    }
+    close(handle);
+    return 0;
+}
 int main(int argc, char **argv) {
     int lines = 0;
     int chars = 0;
-    wc(&lines, &chars);
+    if (argc > 1) {
+        if (wc_file(argv[1], &lines, &chars) < 0) {
+            set_fg(240, 0, 0);
+            put_string("[ERROR] Cannot open file.");
+            restore_fg();
+            return 1;
+        }
+    } else {
+        wc(&lines, &chars);
+    }
     put_int(lines);
     put_string(" ");
     put_int(chars);
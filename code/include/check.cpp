@@ -0,0 +1,20 @@
+//
+// Project: clibparser
+// Created by bajdcc
+//
+
+#include "/include/io"
+
+// 测试断言：输出名称与结果，相等时标记[OK]，否则标记[FAIL]并给出期望值
+int check(char *name, int value, int expect) {
+    put_string(name);
+    put_int(value);
+    if (value == expect) {
+        put_string("  [OK]\n");
+        return 1;
+    }
+    put_string("  [FAIL] expect: ");
+    put_int(expect);
+    put_string("\n");
+    return 0;
+}
@@ -48,4 +48,27 @@ int write(int handle, char c) {
 int truncate(int handle) {
     handle;
     interrupt 70;
+}
+// 整块读写，返回字节数（读完为0）或错误码：-1文件不存在，-2禁止写入，-3句柄无效
+int read_block(int handle, char *buf, int len) {
+    &len;
+    interrupt 71;
+}
+int write_block(int handle, char *buf, int len) {
+    &len;
+    interrupt 72;
+}
+// origin：0开头，1当前，2末尾，返回新的读位置
+int seek(int handle, int offset, int origin) {
+    &origin;
+    interrupt 73;
+}
+// 把文件内容映射到地址空间（末尾补零），mode：0只读，1写时复制（不改动文件），失败返回0
+char *mmap(int handle, int mode) {
+    &mode;
+    interrupt 74;
+}
+int munmap(char *addr) {
+    addr;
+    interrupt 75;
 }
\ No newline at end of file
@@ -37,6 +37,18 @@ unsigned long put_ulong(unsigned number) {
     number;
     interrupt 9;
 }
+int output_write(char *buf, int len) {
+    &len;
+    interrupt 16;
+}
+int put_buffer(char *buf, int len) {
+    int n;
+    while (len > 0) {
+        n = output_write(buf, len);
+        buf += n;
+        len -= n;
+    }
+}
 int input_character(char c) {
     c;
     interrupt 8;
@@ -68,6 +80,11 @@ int input_state() {
 int input_valid() {
     interrupt 14;
 }
+// 整块读取（仅输入重定向到管道时），返回读取的字节数，读完为0，未重定向为-1
+int input_read(char *buf, int len) {
+    &len;
+    interrupt 15;
+}
 int input(char *text, int len) {
     int i, c;
     int state = input_lock();
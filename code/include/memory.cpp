@@ -12,15 +12,15 @@ int free(int addr) {
     addr;
     interrupt 31;
 }
+char *realloc(char *addr, int size) {
+    &size;
+    interrupt 32;
+}
 void memmove(char *dst, char *src, int n) {
-    if (dst < src) while (n-- > 0) *dst++ = *src++;
-    else {
-        src += n - 1;
-        dst += n - 1;
-        while (n-- > 0) *dst-- = *src--;
-    }
+    &n;
+    interrupt 80;
 }
 void memset(char *src, char c, int n) {
-    for (; 0 < n; ++src, --n)
-        *src = c;
+    &n;
+    interrupt 81;
 }
@@ -6,13 +6,12 @@
 // 字符串操作
 
 int strlen(char *text) {
-    int i = 0;
-    while (*text++)
-        i++;
-    return i;
+    text;
+    interrupt 82;
 }
 int strcpy(char *dst, char *src) {
-    while (*dst++ = *src++);
+    &src;
+    interrupt 83;
 }
 int strncpy(char *dst, char *src, int n) {
     if (dst < src) while (n-- > 0 && (*dst++ = *src++));
@@ -23,11 +22,8 @@ int strncpy(char *dst, char *src, int n) {
     }
 }
 int strcmp(char *a, char *b) {
-    int len = 0;
-    while(*a && *b && (*a == *b)) {
-        a++, b++;
-    }
-    return *a - *b;
+    &b;
+    interrupt 84;
 }
 int strncmp(char *a, char *b, int n) {
     while(n-- && *a && *b) {
@@ -42,14 +38,10 @@ int strncmp(char *a, char *b, int n) {
     return *a - *b;
 }
 char *strchr(char *text, char c) {
-    for (; *text; ++text)
-        if (*text == c)
-            return text;
-    return (char *) 0;
+    &c;
+    interrupt 85;
 }
 char *strcat(char *dst, char *src) {
-    char *s = dst;
-    while (*s++); s--;
-    while (*s++ = *src++);
+    strcpy(dst + strlen(dst), src);
     return dst;
 }
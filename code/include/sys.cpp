@@ -18,3 +18,14 @@ int reset_cycle(int cycle) {
 long timestamp() {
     interrupt 102;
 }
+int set_exec_mode(int mode) {
+    mode;
+    interrupt 110;
+}
+long ins_count() {
+    interrupt 111;
+}
+int set_priority(int priority) {
+    priority;
+    interrupt 112;
+}
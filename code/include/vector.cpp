@@ -33,10 +33,7 @@ void vector_push(void *p, void *data) {
     _vector_struct_ *s = (_vector_struct_ *) p;
     if (s->size == s->capacity) {
         s->capacity <<= 1;
-        void *new_data = malloc(s->capacity * s->_sizeof);
-        memmove(new_data, s->data, s->size * s->_sizeof);
-        free(s->data);
-        s->data = new_data;
+        s->data = realloc(s->data, s->capacity * s->_sizeof);
     }
     memmove(s->data + s->size++ * s->_sizeof, data, s->_sizeof);
 }
@@ -53,10 +50,7 @@ void vector_insert(void *p, int n, void *data) {
     if (n >= 0 && n <= s->size) {
         if (s->size == s->capacity) {
             s->capacity <<= 1;
-            void *new_data = malloc(s->capacity * s->_sizeof);
-            memmove(new_data, s->data, s->capacity * s->_sizeof);
-            free(s->data);
-            s->data = new_data;
+            s->data = realloc(s->data, s->capacity * s->_sizeof);
         }
         memmove(s->data + (n + 1) * s->_sizeof,
                 s->data + (n) * s->_sizeof,
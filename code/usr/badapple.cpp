@@ -42,6 +42,15 @@ int print_frame() {
 int read_file(int handle) {
     int c, flag = 0, num, pixels = 80 * 25, px = 0, j;
     char p;
+    char *data = mmap(handle, 0);
+    char *s = data;
+    if (!data) {
+        set_fg(240, 0, 0);
+        put_string("[ERROR] Cannot map file.\n");
+        restore_fg();
+        close(handle);
+        return 0;
+    }
     fps = 0;
     frame = last_frame = 1;
     time = timestamp();
@@ -50,7 +59,7 @@ int read_file(int handle) {
     print_frame();
     set_cycle(1000000);
     sleep(0);
-    while (c = read(handle), c >= 0) {
+    while ((c = *s++) != 0) {
         if (c == (int) ' ' || c == (int) '\r' || c == (int) '\n') { // skip
             continue;
         }
@@ -89,22 +98,9 @@ int read_file(int handle) {
             }
         }
     }
-    switch (c) {
-        case -1:
-            // put_string("[INFO] Read to the end.\n");
-            put_string("\n");
-            break;
-        case -2:
-            set_fg(240, 0, 0);
-            put_string("[ERROR] File already deleted.\n");
-            restore_fg();
-            break;
-        case -3:
-            set_fg(240, 0, 0);
-            put_string("[ERROR] Invalid handle.\n");
-            restore_fg();
-            break;
-    }
+    // put_string("[INFO] Read to the end.\n");
+    put_string("\n");
+    munmap(data);
     close(handle);
 }
 int main(int argc, char **argv) {
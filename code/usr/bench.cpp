@@ -0,0 +1,46 @@
+#include "/include/io"
+#include "/include/shell"
+#include "/include/sys"
+// 各执行模式下运行测试程序，统计每秒执行指令数
+char *modes[3];
+int bench(char *path) {
+    long start_ins = ins_count();
+    long start_time = timestamp();
+    shell(path);
+    long ins = ins_count() - start_ins;
+    long us = timestamp() - start_time;
+    if (us <= 0L)
+        us = 1L;
+    put_string("  ");
+    put_string(path);
+    put_string(": ins = ");
+    put_long(ins);
+    put_string(", ms = ");
+    put_long(us / 1000L);
+    put_string(", ips = ");
+    put_long(ins * 1000000L / us);
+    put_string("\n");
+}
+int main(int argc, char **argv) {
+    int i, old;
+    modes[0] = "switch";
+    modes[1] = "threaded";
+    modes[2] = "jit";
+    old = set_exec_mode(-1);
+    set_cycle(100000);
+    for (i = 0; i < 3; ++i) {
+        set_exec_mode(i);
+        if (set_exec_mode(-1) != i)
+            continue;
+        set_fg(0, 240, 0);
+        put_string("[");
+        put_string(modes[i]);
+        put_string("]\n");
+        restore_fg();
+        bench("/usr/test_rec");
+        bench("/usr/number * 123456789123456789 987654321987654321");
+    }
+    set_cycle(0);
+    set_exec_mode(old);
+    return 0;
+}
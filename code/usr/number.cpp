@@ -33,10 +33,7 @@ big_number new_number2(int n) {
 void append_number(big_number *s, char c) {
     if (s->length >= s->capacity - 1) {
         s->capacity <<= 1;
-        char *new_text = malloc(s->capacity);
-        memmove(new_text, s->text, s->length);
-        free(s->text);
-        s->text = new_text;
+        s->text = realloc(s->text, s->capacity);
     }
     (s->text)[s->length++] = c;
 }
@@ -15,6 +15,9 @@ int main(int argc, char **argv) {
         case 7: shell("/usr/test_xtoa");
         case 8: shell("/usr/test_vector");
         case 9: shell("/usr/test_map");
+        case 10: shell("/usr/test_float");
+        case 11: shell("/usr/test_file");
+        case 12: shell("/usr/test_mmap");
     }
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,90 @@
+#include "/include/io"
+#include "/include/fs"
+#include "/include/memory"
+#include "/include/check"
+// TEST
+char pattern(int i) {
+    return (char) ('a' + i % 26);
+}
+// 校验buf中n个字节是否为文件offset处的内容
+int verify(char *buf, int offset, int n) {
+    int i;
+    for (i = 0; i < n; ++i) {
+        if (buf[i] != pattern(offset + i))
+            return i;
+    }
+    return n;
+}
+int case_1(int h, char *buf) {
+    put_string("-- CASE #1 [write_block] --\n");
+    int i, n = 10000;
+    for (i = 0; i < n; ++i)
+        buf[i] = pattern(i);
+    check("write 10000:   ", write_block(h, buf, n), n);
+    check("write 0:       ", write_block(h, buf, 0), 0);
+}
+int case_2(int h) {
+    put_string("-- CASE #2 [seek] --\n");
+    check("seek 100,0:    ", seek(h, 100, 0), 100);
+    check("seek 50,1:     ", seek(h, 50, 1), 150);
+    check("seek -60,1:    ", seek(h, -60, 1), 90);
+    check("seek -10,2:    ", seek(h, -10, 2), 9990);
+    check("seek 0,2:      ", seek(h, 0, 2), 10000);
+    check("seek -1,0:     ", seek(h, -1, 0), 0);
+    check("seek 99999,0:  ", seek(h, 99999, 0), 10000);
+}
+int case_3(int h, char *buf) {
+    put_string("-- CASE #3 [read_block] --\n");
+    // 目标缓冲区跨越页边界
+    char *dst = (char *) (((int) buf + 8192) & ~4095) - 100;
+    seek(h, 1000, 0);
+    check("read 6000:     ", read_block(h, dst, 6000), 6000);
+    check("verify:        ", verify(dst, 1000, 6000), 6000);
+    check("tell:          ", seek(h, 0, 1), 7000);
+    seek(h, -50, 2);
+    check("read tail:     ", read_block(h, dst, 200), 50);
+    check("verify:        ", verify(dst, 9950, 50), 50);
+    check("read eof:      ", read_block(h, dst, 200), 0);
+    seek(h, 4090, 0);
+    check("read 12:       ", read_block(h, buf, 12), 12);
+    check("verify:        ", verify(buf, 4090, 12), 12);
+}
+int case_4(int h, char *buf) {
+    put_string("-- CASE #4 [error] --\n");
+    check("seek origin 5: ", seek(h, 0, 5), -1);
+    check("open missing:  ", open("/test_file_missing"), -1);
+    int ps = open("/sys/ps");
+    check("write proc:    ", write_block(ps, buf, 10), -2);
+    check("seek proc:     ", seek(ps, 0, 0), 0);
+    close(ps);
+    int dev = open("/dev/random");
+    check("seek stream:   ", seek(dev, 0, 0), -1);
+    close(dev);
+    close(h);
+    check("read closed:   ", read_block(h, buf, 10), -3);
+    check("write closed:  ", write_block(h, buf, 10), -3);
+    check("seek closed:   ", seek(h, 0, 0), -3);
+}
+int main(int argc, char **argv) {
+    int i;
+    put_string("========== [#11 TEST FILE] ==========\n");
+    put_string("Command:");
+    for (i = 0; i < argc; ++i) {
+        put_string(" ");
+        put_string(argv[i]);
+    }
+    put_string("\n");
+    char *name = "/test_file.txt";
+    rm(name);
+    touch(name);
+    int h = open(name);
+    char *buf = malloc(16384);
+    case_1(h, buf);
+    case_2(h);
+    case_3(h, buf);
+    case_4(h, buf);
+    rm(name);
+    free(buf);
+    put_string("========== [#11 TEST FILE] ==========\n");
+    return 0;
+}
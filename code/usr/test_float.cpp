@@ -0,0 +1,58 @@
+#include "/include/io"
+// TEST
+int cmp_float(float a, float b) {
+    int r = 0;
+    if (a == b) r += 1;
+    if (a != b) r += 2;
+    if (a < b) r += 4;
+    if (a <= b) r += 8;
+    if (a > b) r += 16;
+    if (a >= b) r += 32;
+    return r;
+}
+int cmp_double(double a, double b) {
+    int r = 0;
+    if (a == b) r += 1;
+    if (a != b) r += 2;
+    if (a < b) r += 4;
+    if (a <= b) r += 8;
+    if (a > b) r += 16;
+    if (a >= b) r += 32;
+    return r;
+}
+int sum_float(float a, float b) {
+    return (a == b) + (a < b) * 2 + (a > b) * 4;
+}
+int sum_double(double a, double b) {
+    return (a == b) + (a < b) * 2 + (a > b) * 4;
+}
+int test(int n) {
+    int i, s = 0;
+    float f;
+    double d;
+    for (i = 0; i < n; ++i) { // 反复调用，使比较函数进入JIT
+        f = i;
+        d = i;
+        s += cmp_float(f, 50.0) + cmp_double(d, 50.0);
+        s += sum_float(f, 50.0) + sum_double(d, 50.0);
+    }
+    return s;
+}
+int main(int argc, char **argv) {
+    int i;
+    put_string("========== [#10 TEST FLOAT] ==========\n");
+    put_string("Command:");
+    for (i = 0; i < argc; ++i) {
+        put_string(" ");
+        put_string(argv[i]);
+    }
+    put_string("\n");
+    put_string("float  1.5 vs 2.5:  "); put_int(cmp_float(1.5, 2.5)); put_string("\n");
+    put_string("float  2.5 vs 2.5:  "); put_int(cmp_float(2.5, 2.5)); put_string("\n");
+    put_string("double 3.5 vs 2.5:  "); put_int(cmp_double(3.5, 2.5)); put_string("\n");
+    put_string("double 2.5 vs 2.5:  "); put_int(cmp_double(2.5, 2.5)); put_string("\n");
+    put_string("sum(100):           "); put_int(test(100)); put_string("\n");
+    put_string("expect:             6976\n");
+    put_string("========== [#10 TEST FLOAT] ==========\n");
+    return 0;
+}
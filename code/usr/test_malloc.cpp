@@ -2,6 +2,10 @@
 #include "/include/io"
 #include "/include/memory"
 #include "/include/string"
+#include "/include/fs"
+#include "/include/xtoa_itoa"
+#include "/include/xtoa_atoi"
+#include "/include/check"
 char *malloc_log(int size) {
     put_string("[x] MALLOC: ");
     char *ptr = malloc(size);
@@ -40,11 +44,100 @@ int case_2() {
     for (i = 0; i < n; ++i) free_log(ptrs[i]);
     free_log((int) ptrs);
 }
+int fill(char *p, int n, int seed) {
+    int i;
+    for (i = 0; i < n; ++i)
+        p[i] = (char) (seed + i % 97);
+}
+int verify(char *p, int n, int seed) {
+    int i;
+    for (i = 0; i < n; ++i) {
+        if (p[i] != (char) (seed + i % 97))
+            return i;
+    }
+    return n;
+}
+// 读取/proc/[pid]/malloc中某一项的值
+int malloc_stat(char *label) {
+    char *path = malloc(64);
+    char *buf = malloc(256);
+    strcpy(path, "/proc/");
+    i32toa(get_pid(), path + 6);
+    strcat(path, "/malloc");
+    int h = open(path);
+    int n = read_block(h, buf, 255);
+    close(h);
+    buf[n > 0 ? n : 0] = 0;
+    int i, len = strlen(label), value = -1;
+    for (i = 0; buf[i]; ++i) {
+        if (strncmp(buf + i, label, len) == 0) {
+            value = atoi32(buf + i + len);
+            break;
+        }
+    }
+    free((int) path);
+    free((int) buf);
+    return value;
+}
+int case_3() {
+    put_string("-- CASE #3 [realloc] --\n");
+    int count = malloc_stat("realloc: ");
+    int inplace = malloc_stat("in place: ");
+    char *p, *q, *guard;
+    // 小对象，仍在原大小类之内
+    p = malloc(40);
+    fill(p, 40, 1);
+    q = realloc(p, 48);
+    check("small in class: ", q == p, 1);
+    check("verify:         ", verify(q, 40, 1), 40);
+    free((int) q);
+    // 大对象缩小，尾部页归还
+    p = malloc(4096 * 4);
+    fill(p, 4096 * 4, 2);
+    q = realloc(p, 4096 + 1);
+    check("large shrink:   ", q == p, 1);
+    check("verify:         ", verify(q, 4096 + 1, 2), 4096 + 1);
+    free((int) q);
+    // 大对象增大，占用其后的空闲页段
+    p = malloc(4096 * 2);
+    q = malloc(4096 * 2);
+    guard = malloc(4096 * 2);
+    check("layout:         ", (int) q - (int) p == 4096 * 2 && (int) guard - (int) q == 4096 * 2, 1);
+    free((int) q);
+    fill(p, 4096 * 2, 3);
+    q = realloc(p, 4096 * 4);
+    check("large next run: ", q == p, 1);
+    check("verify:         ", verify(q, 4096 * 2, 3), 4096 * 2);
+    // 其后紧邻仍在使用的块，只能复制到新块
+    fill(q, 4096 * 4, 6);
+    p = realloc(q, 4096 * 8);
+    check("large copy:     ", p != q, 1);
+    check("verify:         ", verify(p, 4096 * 4, 6), 4096 * 4);
+    free((int) p);
+    free((int) guard);
+    // 大对象增大，位于堆末尾
+    p = malloc(4096 * 32);
+    fill(p, 4096 * 32, 4);
+    q = realloc(p, 4096 * 64);
+    check("large heap end: ", q == p, 1);
+    check("verify:         ", verify(q, 4096 * 32, 4), 4096 * 32);
+    free((int) q);
+    // 超出原大小类，复制到新块
+    p = malloc(40);
+    fill(p, 40, 5);
+    q = realloc(p, 100);
+    check("small copy:     ", q != p, 1);
+    check("verify:         ", verify(q, 40, 5), 40);
+    free((int) q);
+    check("realloc count:  ", malloc_stat("realloc: ") - count, 6);
+    check("in place count: ", malloc_stat("in place: ") - inplace, 4);
+}
 int main(int argc, char **argv) {
     int i;
     put_string("========== [#5 TEST MALLOC] ==========\n");
     case_1();
     case_2();
+    case_3();
     put_string("========== [#5 TEST MALLOC] ==========\n");
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,98 @@
+#include "/include/io"
+#include "/include/fs"
+#include "/include/proc"
+#include "/include/string"
+#include "/include/check"
+// TEST
+int case_1(int h) {
+    put_string("-- CASE #1 [read only] --\n");
+    char *data = mmap(h, 0);
+    check("mapped:        ", (int) data != 0, 1);
+    check("content:       ", strcmp(data, "hello mmap"), 0);
+    check("zero padded:   ", data[10], 0);
+    check("munmap:        ", munmap(data), 0);
+}
+int case_2(int h) {
+    put_string("-- CASE #2 [copy on write] --\n");
+    char *data = mmap(h, 1);
+    char *ro = mmap(h, 0);
+    data[0] = 'H';
+    check("written:       ", strcmp(data, "Hello mmap"), 0);
+    check("other mapping: ", strcmp(ro, "hello mmap"), 0);
+    seek(h, 0, 0);
+    check("file first:    ", read(h), 'h');
+    check("file size:     ", seek(h, 0, 2), 10);
+    munmap(ro);
+    munmap(data);
+}
+int case_3(int h) {
+    put_string("-- CASE #3 [munmap] --\n");
+    char *a = mmap(h, 0);
+    char *b = mmap(h, 0);
+    check("next page:     ", (int) b - (int) a, 4096);
+    check("munmap b:      ", munmap(b), 0);
+    check("munmap twice:  ", munmap(b), -1);
+    check("munmap bad:    ", munmap(a + 1), -1);
+    char *c = mmap(h, 0);
+    check("reuse top:     ", (int) c - (int) a, 4096);
+    munmap(c);
+    munmap(a);
+    char *d = mmap(h, 0);
+    check("reset top:     ", (int) d - (int) a, 0);
+    munmap(d);
+}
+int case_4(int h) {
+    put_string("-- CASE #4 [fork] --\n");
+    char *ro = mmap(h, 0);
+    char *data = mmap(h, 1);
+    data[0] = 'P';
+    close(h); // 子进程退出时会关闭继承的句柄，故先关闭，映射不受影响
+    int pid = fork();
+    if (pid == -1) {
+        check("child ro:      ", strcmp(ro, "hello mmap"), 0);
+        check("child cow:     ", strcmp(data, "Pello mmap"), 0);
+        data[0] = 'C';
+        check("child write:   ", strcmp(data, "Cello mmap"), 0);
+        exit(0);
+    }
+    wait();
+    check("parent ro:     ", strcmp(ro, "hello mmap"), 0);
+    check("parent cow:    ", strcmp(data, "Pello mmap"), 0);
+    munmap(data);
+    munmap(ro);
+}
+// 写只读映射会使虚拟机报错，须单独运行：/usr/test_mmap fault
+int case_5(int h) {
+    put_string("-- CASE #5 [fault] --\n");
+    char *data = mmap(h, 0);
+    put_string("expect error: read-only mapping cannot be written\n");
+    data[0] = 'F';
+    put_string("[FAIL] no fault\n");
+    close(h);
+}
+int main(int argc, char **argv) {
+    int i;
+    put_string("========== [#12 TEST MMAP] ==========\n");
+    put_string("Command:");
+    for (i = 0; i < argc; ++i) {
+        put_string(" ");
+        put_string(argv[i]);
+    }
+    put_string("\n");
+    char *name = "/test_mmap.txt";
+    rm(name);
+    touch(name);
+    int h = open(name);
+    write_block(h, "hello mmap", 10);
+    if (argc > 1) {
+        case_5(h);
+    } else {
+        case_1(h);
+        case_2(h);
+        case_3(h);
+        case_4(h);
+    }
+    rm(name);
+    put_string("========== [#12 TEST MMAP] ==========\n");
+    return 0;
+}
@@ -0,0 +1,100 @@
+//
+// Project: clibparser
+// Created by bajdcc
+//
+
+#include <algorithm>
+#include "cpool.h"
+
+namespace clib {
+
+    cpool::cpool(int workers) {
+        workers = std::max(0, std::min(workers, POOL_MAX_WORKERS));
+        for (auto i = 0; i < workers; ++i) {
+            threads.emplace_back(&cpool::worker, this);
+        }
+    }
+
+    cpool::~cpool() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stop = true;
+        }
+        start_cv.notify_all();
+        for (auto &t : threads) {
+            t.join();
+        }
+    }
+
+    int cpool::size() const {
+        return (int) threads.size();
+    }
+
+    void cpool::run(int count, const std::function<void(int)> &job) {
+        if (count <= 0)
+            return;
+        if (threads.empty() || count == 1) {
+            for (auto i = 0; i < count; ++i)
+                job(i);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            current = &job;
+            total = count;
+            next = 0;
+            finished = 0;
+            generation++;
+        }
+        start_cv.notify_all();
+        work(&job, count);
+        std::unique_lock<std::mutex> guard(lock);
+        // 须等所有线程离开本批任务，job的生命期才能结束
+        done_cv.wait(guard, [this] { return finished == total && busy == 0; });
+        current = nullptr;
+    }
+
+    // 取任务直到本批取完
+    void cpool::work(const std::function<void(int)> *job, int count) {
+        auto n = 0;
+        for (;;) {
+            auto i = next++;
+            if (i >= count)
+                break;
+            (*job)(i);
+            n++;
+        }
+        if (n > 0) {
+            std::lock_guard<std::mutex> guard(lock);
+            finished += n;
+            if (finished == total)
+                done_cv.notify_all();
+        }
+    }
+
+    void cpool::worker() {
+        uint64_t seen = 0;
+        for (;;) {
+            const std::function<void(int)> *job;
+            int count;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                start_cv.wait(guard, [&] { return stop || generation != seen; });
+                if (stop)
+                    return;
+                seen = generation;
+                job = current;
+                count = total;
+                busy++;
+            }
+            if (job)
+                work(job, count);
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                busy--;
+                if (busy == 0)
+                    done_cv.notify_all();
+            }
+        }
+    }
+}
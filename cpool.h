@@ -0,0 +1,53 @@
+//
+// Project: clibparser
+// Created by bajdcc
+//
+
+#ifndef CLIBPARSER_CPOOL_H
+#define CLIBPARSER_CPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* 工作线程数上限（调用线程也参与执行） */
+#define POOL_MAX_WORKERS 31
+
+namespace clib {
+
+    // 线程池：一批任务按下标分发，各线程从共享计数器取下一个任务（空闲线程自动分担）
+    class cpool {
+    public:
+        explicit cpool(int workers);
+        ~cpool();
+
+        cpool(const cpool &) = delete;
+        cpool &operator=(const cpool &) = delete;
+
+        // 并行执行job(0..count-1)，全部完成后返回
+        void run(int count, const std::function<void(int)> &job);
+        int size() const;
+
+    private:
+        void worker();
+        void work(const std::function<void(int)> *job, int count);
+
+    private:
+        std::vector<std::thread> threads;
+        std::mutex lock;
+        std::condition_variable start_cv;
+        std::condition_variable done_cv;
+        const std::function<void(int)> *current{nullptr};
+        int total{0};
+        std::atomic<int> next{0};
+        int finished{0};
+        int busy{0};
+        uint64_t generation{0};
+        bool stop{false};
+    };
+}
+
+#endif //CLIBPARSER_CPOOL_H
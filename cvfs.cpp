@@ -26,6 +26,51 @@ namespace clib {
         return -1;
     }
 
+    // 逐字节读取，直到读满或不可读
+    int vfs_node_dec::read(byte *data, int n) {
+        auto i = 0;
+        while (i < n && available()) {
+            auto c = index();
+            if (c >= READ_EOF)
+                break;
+            data[i++] = (byte) c;
+            advance();
+        }
+        return i;
+    }
+
+    int vfs_node_dec::write(const byte *data, int n) {
+        for (auto i = 0; i < n; ++i) {
+            auto r = write(data[i]);
+            if (r < 0)
+                return r;
+        }
+        return n;
+    }
+
+    int vfs_node_dec::seek(int, int) {
+        return -1;
+    }
+
+    int vfs_node_dec::seek(int offset, int origin, uint size) {
+        int64 pos;
+        switch (origin) {
+            case 0:
+                pos = offset;
+                break;
+            case 1:
+                pos = (int64) idx + offset;
+                break;
+            case 2:
+                pos = (int64) size + offset;
+                break;
+            default:
+                return -1;
+        }
+        idx = (uint) std::max((int64) 0, std::min(pos, (int64) size));
+        return (int) idx;
+    }
+
     vfs_node_dec::vfs_node_dec(const vfs_mod_query *mod) : mod(mod) {}
 
     vfs_node_solid::vfs_node_solid(const vfs_mod_query *mod, const vfs_node::ref &ref) :
@@ -64,6 +109,39 @@ namespace clib {
         return 0;
     }
 
+    int vfs_node_solid::read(byte *data, int n) {
+        auto nd = node.lock();
+        if (!nd)
+            return -1;
+        if (idx >= nd->data.size())
+            return 0;
+        n = (int) std::min((size_t) n, nd->data.size() - idx);
+        std::copy(nd->data.begin() + idx, nd->data.begin() + idx + n, data);
+        idx += n;
+        return n;
+    }
+
+    // 与write(byte)相同，追加到末尾，读位置停在最后一个字节
+    int vfs_node_solid::write(const byte *data, int n) {
+        auto nd = node.lock();
+        if (!nd)
+            return -1;
+        if (!mod->can_mod(nd, 1))
+            return -2;
+        if (n <= 0)
+            return 0;
+        nd->data.insert(nd->data.end(), data, data + n);
+        idx = nd->data.size() - 1;
+        return n;
+    }
+
+    int vfs_node_solid::seek(int offset, int origin) {
+        auto nd = node.lock();
+        if (!nd)
+            return -1;
+        return vfs_node_dec::seek(offset, origin, nd->data.size());
+    }
+
     int vfs_node_solid::truncate() {
         auto n = node.lock();
         if (!n)
@@ -86,6 +164,28 @@ namespace clib {
         return idx < cache.length() ? cache[idx] : READ_EOF;
     }
 
+    // 生成的只读内容，禁止写入
+    int vfs_node_cached::write(byte) {
+        return -2;
+    }
+
+    int vfs_node_cached::read(byte *data, int n) {
+        if (idx >= cache.length())
+            return 0;
+        n = (int) std::min((size_t) n, cache.length() - idx);
+        std::copy(cache.begin() + idx, cache.begin() + idx + n, data);
+        idx += n;
+        return n;
+    }
+
+    int vfs_node_cached::write(const byte *, int) {
+        return -2;
+    }
+
+    int vfs_node_cached::seek(int offset, int origin) {
+        return vfs_node_dec::seek(offset, origin, cache.length());
+    }
+
     vfs_node_stream::vfs_node_stream(const vfs_mod_query *mod, vfs_stream_t s, vfs_stream_call *call) :
         vfs_node_dec(mod), stream(s), call(call) {}
 
@@ -108,6 +208,10 @@ namespace clib {
         return 0;
     }
 
+    int vfs_node_stream::write(const byte *, int n) {
+        return n;
+    }
+
     vfs_node_stream_net::vfs_node_stream_net(const vfs_mod_query *mod, vfs_stream_t s, vfs_stream_call *call, const string_t &path) :
         vfs_node_dec(mod), stream(s), call(call) {
         content = call->stream_net(stream, path);
@@ -134,6 +238,23 @@ namespace clib {
         return 0;
     }
 
+    int vfs_node_stream_net::read(byte *data, int n) {
+        if (idx >= content.length())
+            return 0;
+        n = (int) std::min((size_t) n, content.length() - idx);
+        std::copy(content.begin() + idx, content.begin() + idx + n, data);
+        idx += n;
+        return n;
+    }
+
+    int vfs_node_stream_net::write(const byte *, int n) {
+        return n;
+    }
+
+    int vfs_node_stream_net::seek(int offset, int origin) {
+        return vfs_node_dec::seek(offset, origin, content.length());
+    }
+
     // -------------------------------------------
 
     cvfs::cvfs() {
@@ -79,9 +79,15 @@ namespace clib {
         virtual void advance();
         virtual int write(byte c);
         virtual int truncate();
+        // 整块读写：返回读取或写入的字节数，出错时为负数（与write(byte)相同）
+        virtual int read(byte *data, int n);
+        virtual int write(const byte *data, int n);
+        // 移动读位置（origin：0开头，1当前，2末尾），返回新位置，不支持时为-1
+        virtual int seek(int offset, int origin);
         virtual ~vfs_node_dec() = default;
     protected:
         explicit vfs_node_dec(const vfs_mod_query *);
+        int seek(int offset, int origin, uint size);
         uint idx{0};
         const vfs_mod_query *mod{nullptr};
     };
@@ -94,6 +100,9 @@ namespace clib {
         int index() const override;
         int write(byte c) override;
         int truncate() override;
+        int read(byte *data, int n) override;
+        int write(const byte *data, int n) override;
+        int seek(int offset, int origin) override;
     private:
         explicit vfs_node_solid(const vfs_mod_query *, const vfs_node::ref &ref);
         vfs_node::weak_ref node;
@@ -104,6 +113,10 @@ namespace clib {
     public:
         bool available() const override;
         int index() const override;
+        int write(byte c) override;
+        int read(byte *data, int n) override;
+        int write(const byte *data, int n) override;
+        int seek(int offset, int origin) override;
     private:
         explicit vfs_node_cached(const vfs_mod_query *, const string_t &str);
         string_t cache;
@@ -123,6 +136,7 @@ namespace clib {
         void advance() override;
         int write(byte c) override;
         int truncate() override;
+        int write(const byte *data, int n) override;
         explicit vfs_node_stream(const vfs_mod_query *, vfs_stream_t, vfs_stream_call *);
     private:
         vfs_stream_t stream{fss_none};
@@ -137,6 +151,9 @@ namespace clib {
         void advance() override;
         int write(byte c) override;
         int truncate() override;
+        int read(byte *data, int n) override;
+        int write(const byte *data, int n) override;
+        int seek(int offset, int origin) override;
         explicit vfs_node_stream_net(const vfs_mod_query *, vfs_stream_t, vfs_stream_call *, const string_t &path);
     private:
         vfs_stream_t stream{fss_none};
@@ -4,11 +4,21 @@
 //
 
 #include <cassert>
+#include <algorithm>
 #include <memory.h>
+#include <cstddef>
 #include <cstring>
 #include <regex>
 #include <random>
 #include <asio/system_error.hpp>
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
 #include "cvm.h"
 #include "cgen.h"
 #include "cexception.h"
@@ -28,41 +38,66 @@ namespace clib {
 
     cvm::global_state_t cvm::global_state;
 
-    uint32_t cvm::pmm_alloc(bool reusable) {
-        auto ptr = (uint32_t) memory.alloc_array<byte>(PAGE_SIZE * 2);
-        if (!ptr)
-            error("alloc page failed");
-        if (reusable)
-            ctx->allocation.push_back(ptr);
-        auto page = PAGE_ALIGN_UP(ptr);
-        memset((void *) page, 0, PAGE_SIZE);
+    // 优先复用已释放的页框，否则取用过的最高页框之上的一页
+    uint32_t cvm::pmm_alloc() {
+        uint32_t frame;
+        if (!frame_free.empty()) {
+            frame = frame_free.back();
+            frame_free.pop_back();
+            frame_refs[frame] = 1;
+        } else {
+            frame = (uint32_t) frame_refs.size();
+            if (frame >= PHY_PAGES)
+                error("alloc page failed");
+#if defined(_WIN32)
+            if (!VirtualAlloc(phy_mem + frame * PAGE_SIZE, PAGE_SIZE, MEM_COMMIT, PAGE_READWRITE))
+                error("alloc page failed");
+#endif
+            frame_refs.push_back(1);
+        }
+        auto page = frame * PAGE_SIZE;
+        memset(pmm_addr(page), 0, PAGE_SIZE);
         return page;
     }
 
-    void cvm::vmm_init() {
-        pgd_kern = (pde_t *) malloc(PTE_SIZE * sizeof(pde_t));
-        memset(pgd_kern, 0, PTE_SIZE * sizeof(pde_t));
-        pte_kern = (pte_t *) malloc(PTE_COUNT * PTE_SIZE * sizeof(pte_t));
-        memset(pte_kern, 0, PTE_COUNT * PTE_SIZE * sizeof(pte_t));
-        pgdir = pgd_kern;
+    void cvm::pmm_free(uint32_t page) {
+        auto frame = PAGE_FRAME(page);
+        if (frame == 0 || frame >= frame_refs.size() || frame_refs[frame] <= 0)
+            return;
+        if (--frame_refs[frame] == 0)
+            frame_free.push_back(frame);
+    }
 
-        uint32_t i;
+    byte *cvm::pmm_addr(uint32_t pa) const {
+        return phy_mem + pa;
+    }
 
-        // map 4G memory, physcial address = virtual address
-        for (i = 0; i < PTE_SIZE; i++) {
-            pgd_kern[i] = (uint32_t) pte_kern[i] | PTE_P | PTE_R | PTE_K;
-        }
+    void cvm::vmm_init() {
+        // 只保留地址空间，Linux下首次写入时才分配，Windows下由pmm_alloc逐页提交
+#if defined(_WIN32)
+        phy_mem = (byte *) VirtualAlloc(nullptr, PHY_PAGES * PAGE_SIZE, MEM_RESERVE, PAGE_NOACCESS);
+#else
+        phy_mem = (byte *) mmap(nullptr, PHY_PAGES * PAGE_SIZE, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (phy_mem == MAP_FAILED)
+            phy_mem = nullptr;
+#endif
+        if (!phy_mem)
+            error("alloc physical memory failed");
+        frame_refs.assign(1, 1); // 页框0保留，物理地址0表示页表不存在
 
-        uint32_t *pte = (uint32_t *) pte_kern;
-        for (i = 1; i < PTE_COUNT * PTE_SIZE; i++) {
-            pte[i] = (i << 12) | PTE_P | PTE_R | PTE_K; // i是页表号
-        }
+        uint32_t i;
 
         for (i = 0; i < TASK_NUM; ++i) {
             tasks[i].flag = 0;
             tasks[i].id = i;
             tasks[i].parent = -1;
             tasks[i].state = CTS_DEAD;
+            tasks[i].pgdir = 0;
+            tasks[i].sleeping = false;
+            tasks[i].waiting_child = false;
+            tasks[i].priority = PRIORITY_DEFAULT;
+            tasks[i].queued = false;
         }
         for (i = 0; i < HANDLE_NUM; ++i) {
             handles[i].type = h_none;
@@ -75,6 +110,8 @@ namespace clib {
         fs.as_root(true);
         fs.mkdir("/sys");
         fs.func("/sys/ps", this);
+        fs.func("/sys/ins", this);
+        fs.func("/sys/boot", this);
         fs.mkdir("/proc");
         fs.mkdir("/dev");
         fs.func("/dev/random", this);
@@ -91,21 +128,16 @@ namespace clib {
         uint32_t pde_idx = PDE_INDEX(va); // 页目录号
         uint32_t pte_idx = PTE_INDEX(va); // 页表号
 
-        pte_t *pte = (pte_t *) (pgdir[pde_idx] & PAGE_MASK); // 页表
+        pte_t *pte = vmm_table(ctx->pgdir, va); // 页表
 
         if (!pte) { // 缺页
-            if (va >= USER_BASE) { // 若是用户地址则转换
-                pte = (pte_t *) pmm_alloc(false); // 申请物理页框，用作新页表
-                pgdir[pde_idx] = (uint32_t) pte | PTE_P | flags; // 设置页表
-                pte[pte_idx] = (pa & PAGE_MASK) | PTE_P | flags; // 设置页表项
-            } else { // 内核地址不转换
-                pte = (pte_t *) (pgd_kern[pde_idx] & PAGE_MASK); // 取得内核页表
-                pgdir[pde_idx] = (uint32_t) pte | PTE_P | flags; // 设置页表
-            }
-        } else { // pte存在
-            pte[pte_idx] = (pa & PAGE_MASK) | PTE_P | flags; // 设置页表项
+            auto table = pmm_alloc(); // 申请物理页框，用作新页表
+            ((pde_t *) pmm_addr(ctx->pgdir))[pde_idx] = table | PTE_P | flags; // 设置页表
+            pte = (pte_t *) pmm_addr(table);
         }
+        pte[pte_idx] = (pa & PAGE_MASK) | PTE_P | flags; // 设置页表项
 
+        tlb_invalidate(va);
 #if 0
         printf("MEMMAP> V=%08X P=%08X\n", va, pa);
 #endif
@@ -113,10 +145,9 @@ namespace clib {
 
     // 释放虚页
     void cvm::vmm_unmap(uint32_t va) {
-        uint32_t pde_idx = PDE_INDEX(va);
         uint32_t pte_idx = PTE_INDEX(va);
 
-        pte_t *pte = (pte_t *) (pgdir[pde_idx] & PAGE_MASK);
+        pte_t *pte = vmm_table(ctx->pgdir, va);
 
         if (!pte) {
             return;
@@ -126,14 +157,37 @@ namespace clib {
         printf("MEMUNMAP> V=%08X\n", va);
 #endif
         pte[pte_idx] = 0; // 清空页表项，此时有效位为零
+        tlb_invalidate(va);
+    }
+
+    void cvm::tlb_flush() {
+        if (!ctx)
+            return;
+        for (auto &t : ctx->tlb) {
+            t.tag = 0;
+            t.page = nullptr;
+        }
+    }
+
+    void cvm::tlb_invalidate(uint32_t va) {
+        if (!ctx)
+            return;
+        auto &t = ctx->tlb[TLB_INDEX(va)];
+        if ((t.tag & PAGE_MASK) == (va & PAGE_MASK))
+            t.tag = 0;
+    }
+
+    // 页目录项中存页表的物理地址，零表示页表不存在
+    pte_t *cvm::vmm_table(uint32_t dir, uint32_t va) const {
+        auto table = ((pde_t *) pmm_addr(dir))[PDE_INDEX(va)] & PAGE_MASK;
+        return table ? (pte_t *) pmm_addr(table) : nullptr;
     }
 
     // 是否已分页
     int cvm::vmm_ismap(uint32_t va, uint32_t *pa) const {
-        uint32_t pde_idx = PDE_INDEX(va);
         uint32_t pte_idx = PTE_INDEX(va);
 
-        pte_t *pte = (pte_t *) (pgdir[pde_idx] & PAGE_MASK);
+        pte_t *pte = vmm_table(ctx->pgdir, va);
         if (!pte) {
             return 0; // 页表不存在
         }
@@ -144,22 +198,209 @@ namespace clib {
         return 0; // 页表项不存在
     }
 
-    string_t cvm::vmm_getstr(uint32_t va) const {
-        std::stringstream ss;
-        char c;
-        while (c = vmm_get<char>(va++), c) ss << c;
-        return ss.str();
+    pte_t *cvm::vmm_pte(uint32_t va) const {
+        auto pte = vmm_table(ctx->pgdir, va);
+        if (!pte || !(pte[PTE_INDEX(va)] & PTE_P))
+            return nullptr;
+        return &pte[PTE_INDEX(va)];
+    }
+
+    // fork时共享父进程页目录dir中的全部页框：代码页与只读映射只读共享，其余页双方均改为写时复制
+    void cvm::vmm_share(uint32_t dir) {
+        auto d = (pde_t *) pmm_addr(dir);
+        for (uint32_t i = 0; i < PDE_SIZE; ++i) {
+            if (!(d[i] & PTE_P))
+                continue;
+            auto table = (pte_t *) pmm_addr(d[i] & PAGE_MASK);
+            for (uint32_t j = 0; j < PTE_SIZE; ++j) {
+                auto &pte = table[j];
+                if (!(pte & PTE_P))
+                    continue;
+                auto va = (i << 22) | (j << 12);
+                auto page = pte & PAGE_MASK;
+                if ((va & 0xF0000000) == USER_BASE || !(pte & (PTE_R | PTE_C))) {
+                    vmm_map(va, page, PTE_U | PTE_P);
+                } else {
+                    pte = (pte & ~PTE_R) | PTE_C;
+                    vmm_map(va, page, PTE_U | PTE_P | PTE_C);
+                }
+                frame_refs[PAGE_FRAME(page)]++;
+            }
+        }
+    }
+
+    // 写入共享页：仍有其他引用则复制一份，否则直接改为可写，返回新的页表项
+    uint32_t cvm::vmm_cow(uint32_t va) {
+        std::lock_guard<std::mutex> guard(frame_lock);
+        auto pte = vmm_pte(va);
+        auto page = *pte & PAGE_MASK;
+        if (frame_refs[PAGE_FRAME(page)] > 1) {
+            auto new_page = pmm_alloc();
+            std::memcpy(pmm_addr(new_page), pmm_addr(page), PAGE_SIZE);
+            frame_refs[PAGE_FRAME(page)]--;
+            *pte = new_page | (*pte & ~PAGE_MASK);
+        }
+        *pte = (*pte & ~PTE_C) | PTE_R;
+        tlb_invalidate(va);
+        return *pte;
+    }
+
+    // 缺页处理，返回新的页表项，无法处理返回零
+    // 栈区：从已映射的最低页向下补齐到va所在页，落在保护页即栈溢出
+    // 堆区：已分配给堆的虚拟页首次访问时映射一个零页
+    uint32_t cvm::vmm_fault(uint32_t va) {
+        if ((va & 0xF0000000) == HEAP_BASE) {
+            if (!ctx->pool || va - HEAP_BASE >= (uint32_t) ctx->pool->page_size() * PAGE_SIZE)
+                return 0;
+            std::lock_guard<std::mutex> guard(frame_lock);
+            vmm_map(va & PAGE_MASK, pmm_alloc(), PTE_U | PTE_P | PTE_R); // 用户堆空间
+            return *vmm_pte(va);
+        }
+        auto off = va - STACK_BASE;
+        if (off >= STACK_LIMIT)
+            return 0;
+        if (off < STACK_GUARD)
+            error("stack overflow");
+        std::lock_guard<std::mutex> guard(frame_lock);
+        auto low = STACK_TOP - PAGE_SIZE * (uint32_t) ctx->stack_mem.size();
+        while (low > va) {
+            low -= PAGE_SIZE;
+            auto new_page = pmm_alloc();
+            ctx->stack_mem.push_back(new_page);
+            vmm_map(low, new_page, PTE_U | PTE_P | PTE_R); // 用户栈空间
+        }
+        return *vmm_pte(va);
+    }
+
+    // 进程退出：交还各页框的引用，释放页表与页目录
+    void cvm::vmm_release() {
+        if (!ctx->pgdir)
+            return;
+        auto d = (pde_t *) pmm_addr(ctx->pgdir);
+        for (uint32_t i = 0; i < PDE_SIZE; ++i) {
+            if (!(d[i] & PTE_P))
+                continue;
+            auto table = (pte_t *) pmm_addr(d[i] & PAGE_MASK);
+            for (uint32_t j = 0; j < PTE_SIZE; ++j) {
+                if (table[j] & PTE_P)
+                    pmm_free(table[j] & PAGE_MASK);
+            }
+            pmm_free(d[i] & PAGE_MASK);
+        }
+        pmm_free(ctx->pgdir);
+        ctx->pgdir = 0;
+        tlb_flush();
+    }
+
+    uint32_t cvm::vmm_resident(uint32_t dir, uint32_t begin, uint32_t last) const {
+        if (!dir)
+            return 0;
+        auto d = (pde_t *) pmm_addr(dir);
+        uint32_t n = 0;
+        for (auto i = PDE_INDEX(begin); i <= PDE_INDEX(last); ++i) {
+            if (!(d[i] & PTE_P))
+                continue;
+            auto table = (pte_t *) pmm_addr(d[i] & PAGE_MASK);
+            for (uint32_t j = 0; j < PTE_SIZE; ++j) {
+                auto va = (i << 22) | (j << 12);
+                if ((table[j] & PTE_P) && va >= (begin & PAGE_MASK) && va <= last)
+                    n++;
+            }
+        }
+        return n;
+    }
+
+    string_t cvm::vmm_getstr(uint32_t va) {
+        string_t str;
+        for (;;) {
+            uint32_t left;
+            auto p = (const char *) vmm_page(va, left, false);
+            auto end = (const char *) std::memchr(p, 0, left);
+            if (end) {
+                str.append(p, end);
+                return str;
+            }
+            str.append(p, left);
+            va += left;
+        }
+    }
+
+    // 取得va的宿主地址及所在页的剩余字节数，权限检查与vmm_get/vmm_set一致
+    byte *cvm::vmm_page(uint32_t va, uint32_t &left, bool write) {
+        if (va == 0)
+            error(write ? "vmm::set nullptr deref!!" : "vmm::get nullptr deref!!");
+        left = PAGE_SIZE - OFFSET_INDEX(va);
+        auto &t = ctx->tlb[TLB_INDEX(va)];
+        auto tag = (va & PAGE_MASK) | TLB_R | TLB_W;
+        if ((write ? t.tag : (t.tag | TLB_W)) == tag) {
+            ctx->tlb_hit++;
+            return t.page + OFFSET_INDEX(va);
+        }
+        ctx->tlb_miss++;
+        auto code = (va & 0xF0000000) == USER_BASE;
+        if (write && !(ctx->flag & CTX_KERNEL) && (ctx->flag & CTX_USER_MODE) && code) {
+            error("code segment cannot be written");
+        }
+        auto pte = vmm_pte(va);
+        if (pte || vmm_fault(va)) {
+            auto e = pte ? *pte : *vmm_pte(va);
+            if (write && !code && !(e & (PTE_R | PTE_C)))
+                error("read-only mapping cannot be written");
+            if (write && (e & PTE_C))
+                e = vmm_cow(va);
+            t.tag = (va & PAGE_MASK) | TLB_R | (code || !(e & PTE_R) ? 0 : TLB_W);
+            t.page = pmm_addr(e & PAGE_MASK);
+            return t.page + OFFSET_INDEX(va);
+        }
+#if 1
+        printf("[SYSTEM] MEM  | Invalid VA: %08X\n", va);
+#endif
+        error(write ? "vmm::set error" : "vmm::get error");
+        return nullptr;
+    }
+
+    void cvm::vmm_read(uint32_t va, byte *data, uint32_t count) {
+        while (count > 0) {
+            uint32_t left;
+            auto p = vmm_page(va, left, false);
+            auto n = std::min(left, count);
+            std::memcpy(data, p, n);
+            data += n;
+            va += n;
+            count -= n;
+        }
+    }
+
+    void cvm::vmm_write(uint32_t va, const byte *data, uint32_t count) {
+        while (count > 0) {
+            uint32_t left;
+            auto p = vmm_page(va, left, true);
+            auto n = std::min(left, count);
+            std::memcpy(p, data, n);
+            data += n;
+            va += n;
+            count -= n;
+        }
     }
 
     template<class T>
-    T cvm::vmm_get(uint32_t va) const {
+    T cvm::vmm_get(uint32_t va) {
         if (va == 0)
             error("vmm::get nullptr deref!!");
-        if (!(ctx->flag & CTX_KERNEL))
-            va |= ctx->mask;
-        uint32_t pa;
-        if (vmm_ismap(va, &pa)) {
-            return *(T *) ((byte *) pa + OFFSET_INDEX(va));
+        auto &t = ctx->tlb[TLB_INDEX(va)];
+        if ((t.tag | TLB_W) == ((va & PAGE_MASK) | TLB_R | TLB_W)) {
+            ctx->tlb_hit++;
+            return *(T *) (t.page + OFFSET_INDEX(va));
+        }
+        ctx->tlb_miss++;
+        auto pte = vmm_pte(va);
+        if (pte || vmm_fault(va)) {
+            pte = vmm_pte(va);
+            // 代码段、写时复制页与只读映射只读，其余可写
+            auto ro = (va & 0xF0000000) == USER_BASE || !(*pte & PTE_R);
+            t.tag = (va & PAGE_MASK) | TLB_R | (ro ? 0 : TLB_W);
+            t.page = pmm_addr(*pte & PAGE_MASK);
+            return *(T *) (t.page + OFFSET_INDEX(va));
         }
         //vmm_map(va, pmm_alloc(), PTE_U | PTE_P | PTE_R);
 #if 1
@@ -171,15 +412,26 @@ namespace clib {
 
     template<class T>
     T cvm::vmm_set(uint32_t va, T value) {
-        if (!(ctx->flag & CTX_KERNEL)) {
-            if ((ctx->flag & CTX_USER_MODE) && (va & 0xF0000000) == USER_BASE) {
-                error("code segment cannot be written");
-            }
-            va |= ctx->mask;
+        auto &t = ctx->tlb[TLB_INDEX(va)];
+        if (t.tag == ((va & PAGE_MASK) | TLB_R | TLB_W)) { // 命中即说明不是代码段
+            ctx->tlb_hit++;
+            *(T *) (t.page + OFFSET_INDEX(va)) = value;
+            return value;
         }
-        uint32_t pa;
-        if (vmm_ismap(va, &pa)) {
-            *(T *) ((byte *) pa + OFFSET_INDEX(va)) = value;
+        ctx->tlb_miss++;
+        auto code = (va & 0xF0000000) == USER_BASE;
+        if (!(ctx->flag & CTX_KERNEL) && (ctx->flag & CTX_USER_MODE) && code) {
+            error("code segment cannot be written");
+        }
+        auto pte = vmm_pte(va);
+        if (pte || vmm_fault(va)) {
+            pte = vmm_pte(va);
+            if (!code && !(*pte & (PTE_R | PTE_C)))
+                error("read-only mapping cannot be written");
+            auto e = *pte & PTE_C ? vmm_cow(va) : *pte;
+            t.tag = (va & PAGE_MASK) | TLB_R | (code ? 0 : TLB_W);
+            t.page = pmm_addr(e & PAGE_MASK);
+            *(T *) (t.page + OFFSET_INDEX(va)) = value;
             return value;
         }
         //vmm_map(va, pmm_alloc(), PTE_U | PTE_P | PTE_R);
@@ -191,11 +443,60 @@ namespace clib {
     }
 
     void cvm::vmm_setstr(uint32_t va, const string_t &str) {
-        auto len = str.length();
-        for (uint32_t i = 0; i < len; i++) {
-            vmm_set(va + i, str[i]);
+        vmm_write(va, (const byte *) str.c_str(), (uint32_t) str.length() + 1);
+    }
+
+    // 映射长度多留一个零字节，文件内容可直接当作字符串扫描；读位置保持不变
+    // 只读映射写入即出错，写时复制映射写入后为私有副本，均不影响文件
+    uint32_t cvm::vmm_mmap(vfs_node_dec *dec, bool cow) {
+        auto pos = dec->seek(0, 1);
+        auto size = dec->seek(0, 2);
+        if (pos < 0 || size < 0)
+            return 0;
+        auto n = (uint32_t) PAGE_ALIGN_UP((uint32_t) size + 1) / PAGE_SIZE;
+        if (ctx->mmap_top - MMAP_BASE + n * PAGE_SIZE > SEGMENT_MASK + 1U)
+            return 0;
+        auto va = ctx->mmap_top;
+        // 先确认空闲页框（含区间内尚不存在的页表）足够，避免分配到一半失败
+        auto need = n;
+        for (auto d = PDE_INDEX(va); d <= PDE_INDEX(va + n * PAGE_SIZE - 1); ++d) {
+            if (!vmm_table(ctx->pgdir, d << 22))
+                need++;
         }
-        vmm_set(va + len, '\0');
+        if (PHY_PAGES - frame_refs.size() + frame_free.size() < need)
+            return 0;
+        dec->seek(0, 0);
+        for (uint32_t i = 0; i < n; ++i) {
+            auto page = pmm_alloc();
+            dec->read(pmm_addr(page), PAGE_SIZE);
+            vmm_map(va + i * PAGE_SIZE, page, PTE_U | PTE_P | (cow ? PTE_C : 0)); // 文件映射
+        }
+        dec->seek(pos, 0);
+        ctx->mmap_top += n * PAGE_SIZE;
+        ctx->mmaps.insert(std::make_pair(va, n));
+        return va;
+    }
+
+    // 解除映射，收回末尾不再使用的地址空间
+    int cvm::vmm_munmap(uint32_t va) {
+        auto m = ctx->mmaps.find(va);
+        if (m == ctx->mmaps.end())
+            return -1;
+        for (uint32_t i = 0; i < m->second; ++i) {
+            auto pte = vmm_pte(va + i * PAGE_SIZE);
+            if (pte) {
+                pmm_free(*pte & PAGE_MASK);
+                vmm_unmap(va + i * PAGE_SIZE);
+            }
+        }
+        ctx->mmaps.erase(m);
+        if (ctx->mmaps.empty()) {
+            ctx->mmap_top = MMAP_BASE;
+        } else {
+            auto &last = *ctx->mmaps.rbegin();
+            ctx->mmap_top = last.first + last.second * PAGE_SIZE;
+        }
+        return 0;
     }
 
     uint32_t vmm_pa2va(uint32_t base, uint32_t pa) {
@@ -210,44 +511,133 @@ namespace clib {
         if ((addr & 0xF0000000) != HEAP_BASE) {
             return 0;
         }
-        return ctx->pool->free(K2U(addr));
+        return ctx->pool->free(addr & SEGMENT_MASK);
     }
 
-    uint32_t cvm::vmm_memset(uint32_t va, uint32_t value, uint32_t count) {
-#if 0
-        uint32_t pa;
-        if (vmm_ismap(va, &pa))
-        {
-            pa |= OFFSET_INDEX(va);
-            printf("MEMSET> V=%08X P=%08X S=%08X\n", va, pa, count);
-        }
-        else
-        {
-            printf("MEMSET> V=%08X P=ERROR S=%08X\n", va, count);
+    // 能原地调整则不动，否则新分配一块，在宿主侧按页复制后释放原块
+    uint32_t cvm::vmm_realloc(uint32_t addr, uint32_t size) {
+        if (addr == 0)
+            return vmm_malloc(size);
+        if ((addr & 0xF0000000) != HEAP_BASE)
+            error("realloc: invalid address");
+        if (size == 0) {
+            vmm_free(addr);
+            return 0;
         }
-#endif
-        for (uint32_t i = 0; i < count; i++) {
-#if 0
-            printf("MEMSET> V=%08X\n", va + i);
-#endif
-            vmm_set<byte>(va + i, value);
+        auto old = addr & SEGMENT_MASK;
+        if (ctx->pool->resize(old, size))
+            return addr;
+        auto count = std::min(ctx->pool->size_of(old), size);
+        auto new_addr = vmm_malloc(size);
+        vmm_memmove(new_addr, addr, count);
+        vmm_free(addr);
+        return new_addr;
+    }
+
+    uint32_t cvm::vmm_memset(uint32_t va, uint32_t value, uint32_t count) {
+        while (count > 0) {
+            uint32_t left;
+            auto p = vmm_page(va, left, true);
+            auto n = std::min(left, count);
+            std::memset(p, (byte) value, n);
+            va += n;
+            count -= n;
         }
         return 0;
     }
 
     uint32_t cvm::vmm_memcmp(uint32_t src, uint32_t dst, uint32_t count) {
-        for (uint32_t i = 0; i < count; i++) {
-#if 0
-            printf("MEMCMP> '%c':'%c'\n", vmm_get<byte>(src + i), vmm_get<byte>(dst + i));
-#endif
-            if (vmm_get<byte>(src + i) > vmm_get<byte>(dst + i))
+        while (count > 0) {
+            uint32_t left_src, left_dst;
+            auto p = vmm_page(src, left_src, false);
+            auto q = vmm_page(dst, left_dst, false);
+            auto n = std::min(std::min(left_src, left_dst), count);
+            auto r = std::memcmp(p, q, n);
+            if (r > 0)
                 return 1;
-            if (vmm_get<byte>(src + i) < vmm_get<byte>(dst + i))
+            if (r < 0)
                 return 2;
+            src += n;
+            dst += n;
+            count -= n;
         }
         return 0;
     }
 
+    // 区间重叠时与memmove一致：目标在前则从前往后复制，否则从后往前
+    void cvm::vmm_memmove(uint32_t dst, uint32_t src, uint32_t count) {
+        if (dst == src || count == 0)
+            return;
+        uint32_t left_src, left_dst;
+        if (dst < src || dst >= src + count) {
+            while (count > 0) {
+                auto p = vmm_page(src, left_src, false);
+                auto q = vmm_page(dst, left_dst, true);
+                auto n = std::min(std::min(left_src, left_dst), count);
+                std::memmove(q, p, n);
+                src += n;
+                dst += n;
+                count -= n;
+            }
+        } else {
+            while (count > 0) {
+                // 末字节所在页内，末字节及其之前的字节数
+                auto n = std::min(std::min(OFFSET_INDEX(src + count - 1), OFFSET_INDEX(dst + count - 1)) + 1,
+                                  count);
+                auto p = vmm_page(src + count - n, left_src, false);
+                auto q = vmm_page(dst + count - n, left_dst, true);
+                std::memmove(q, p, n);
+                count -= n;
+            }
+        }
+    }
+
+    uint32_t cvm::vmm_strlen(uint32_t va) {
+        uint32_t len = 0;
+        for (;;) {
+            uint32_t left;
+            auto p = vmm_page(va + len, left, false);
+            auto end = (const byte *) std::memchr(p, 0, left);
+            if (end)
+                return len + (uint32_t) (end - p);
+            len += left;
+        }
+    }
+
+    // 返回首个不同字节之差（按无符号字节），与库中逐字节比较的结果一致
+    int cvm::vmm_strcmp(uint32_t a, uint32_t b) {
+        for (;;) {
+            uint32_t left_a, left_b;
+            auto p = vmm_page(a, left_a, false);
+            auto q = vmm_page(b, left_b, false);
+            auto n = std::min(left_a, left_b);
+            for (uint32_t i = 0; i < n; ++i) {
+                if (p[i] != q[i] || !p[i])
+                    return (int) p[i] - (int) q[i];
+            }
+            a += n;
+            b += n;
+        }
+    }
+
+    // 查找字符，到字符串结尾为止，找不到返回零
+    uint32_t cvm::vmm_strchr(uint32_t va, int c) {
+        for (;;) {
+            uint32_t left;
+            auto p = vmm_page(va, left, false);
+            auto end = (const byte *) std::memchr(p, 0, left);
+            auto n = end ? (uint32_t) (end - p) : left;
+            if (c > 0 && c <= 0xFF) {
+                auto found = (const byte *) std::memchr(p, c, n);
+                if (found)
+                    return va + (uint32_t) (found - p);
+            }
+            if (end)
+                return 0;
+            va += left;
+        }
+    }
+
     template<class T>
     void cvm::vmm_pushstack(uint32_t &sp, T value) {
         sp -= sizeof(T);
@@ -263,22 +653,74 @@ namespace clib {
 
     //-----------------------------------------
 
+#if CVM_PARALLEL
+    thread_local cvm::context_t *cvm::ctx{nullptr};
+    thread_local std::unique_ptr<cexception> cvm::jit_fault;
+#endif
+
     cvm::cvm() {
+        auto start = std::chrono::high_resolution_clock::now();
+        ctx = nullptr;
+        jit_fault.reset();
+        // 重启时丢弃上一个虚拟机遗留的输入状态与等待队列
+        global_state.input_lock = -1;
+        global_state.input_lock_list.clear();
+        global_state.input_waiting_list.clear();
+        global_state.input_read_list.clear();
+        global_state.input_read_ptr = -1;
+        global_state.input_content.clear();
+        global_state.input_success = false;
         vmm_init();
+#if CVM_PARALLEL
+        workers = std::make_unique<cpool>((int) std::thread::hardware_concurrency() - 1);
+#endif
+        boot_us = (uint64) std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::high_resolution_clock::now() - start).count();
+#if LOG_SYSTEM
+        printf("[SYSTEM] BOOT | VM init: %llu us\n", boot_us);
+#endif
     }
 
     cvm::~cvm() {
-        free(pgd_kern);
-        free(pte_kern);
+#if defined(_WIN32)
+        VirtualFree(phy_mem, 0, MEM_RELEASE);
+#else
+        munmap(phy_mem, PHY_PAGES * PAGE_SIZE);
+#endif
     }
 
+    // 按优先级从高到低，每级内轮转，每个就绪进程执行一个时间片
     bool cvm::run(int cycle, int &cycles) {
-        for (int i = 0; i < TASK_NUM; ++i) {
-            if (tasks[i].flag & CTX_VALID) {
-                if (tasks[i].state == CTS_RUNNING) {
-                    ctx = &tasks[i];
-                    exec(cycle, cycles);
+        wake_timers();
+#if CVM_PARALLEL
+        if (workers->size() > 0 && global_state.exec_mode != EXEC_SWITCH && cycle >= PARALLEL_MIN_CYCLE)
+            run_parallel(cycle, cycles);
+        else
+#endif
+        for (auto level = 0; level < PRIORITY_NUM; ++level) {
+            auto &queue = ready_queue[level];
+            for (auto n = queue.size(); n > 0 && !queue.empty(); --n) {
+                auto &c = tasks[queue.front()];
+                queue.pop_front();
+                if (!(c.flag & CTX_VALID) || c.state != CTS_RUNNING) {
+                    c.queued = false;
+                    continue;
+                }
+                if (c.priority != level) {
+                    ready_queue[c.priority].push_back(c.id);
+                    continue;
                 }
+                ctx = &c;
+                auto start = cycles;
+                if (global_state.exec_mode != EXEC_SWITCH)
+                    exec_threaded(slice(c, cycle), cycles);
+                else
+                    exec(slice(c, cycle), cycles);
+                ins_total += cycles - start;
+                if ((c.flag & CTX_VALID) && c.state == CTS_RUNNING)
+                    ready_queue[c.priority].push_back(c.id);
+                else
+                    c.queued = false;
             }
         }
         if (global_state.interrupt) {
@@ -300,6 +742,181 @@ namespace clib {
         return available_tasks > 0;
     }
 
+    // 唤醒到期的睡眠进程；堆中可能残留已被其他途径唤醒或已退出的进程，按sleeping标记忽略
+    void cvm::wake_timers() {
+        if (timers.empty())
+            return;
+        auto now = std::chrono::high_resolution_clock::now();
+        while (!timers.empty() && timers.top().deadline <= now) {
+            auto &c = tasks[timers.top().id];
+            timers.pop();
+            if ((c.flag & CTX_VALID) && c.sleeping && c.state == CTS_WAIT) {
+                c.sleeping = false;
+                set_state(c, CTS_RUNNING);
+            }
+        }
+    }
+
+    void cvm::wait_on(std::deque<int> &q) {
+        q.push_back(ctx->id);
+        set_state(*ctx, CTS_WAIT);
+    }
+
+    // 唤醒队首的进程并返回其pid；进程退出时已从队列中移除
+    int cvm::wake_one(std::deque<int> &q) {
+        while (!q.empty()) {
+            auto id = q.front();
+            q.pop_front();
+            auto &c = tasks[id];
+            if ((c.flag & CTX_VALID) && c.state == CTS_WAIT) {
+                set_state(c, CTS_RUNNING);
+                return id;
+            }
+        }
+        return -1;
+    }
+
+    void cvm::wake_all(std::deque<int> &q) {
+        while (!q.empty())
+            wake_one(q);
+    }
+
+    // 释放输入锁：有进程排队则直接交给队首（醒来即已持锁），否则唤醒被阻塞的输出
+    void cvm::input_release() {
+        global_state.input_lock = -1;
+        global_state.input_read_ptr = -1;
+        global_state.input_content.clear();
+        global_state.input_success = false;
+        auto id = wake_one(global_state.input_lock_list);
+        if (id != -1) {
+            global_state.input_lock = id;
+            cgui::singleton().input_set(true);
+        } else {
+            cgui::singleton().input_set(false);
+            wake_all(global_state.input_waiting_list);
+        }
+    }
+
+    void cvm::input_wake() {
+        wake_all(global_state.input_read_list);
+    }
+
+    // 写入尾部：空间不足时只写入能放下的部分
+    uint32_t cvm::pipe_t::write(const byte *data, uint32_t n) {
+        if (buf.empty())
+            buf.resize(PIPE_SIZE);
+        n = std::min(n, space());
+        auto tail = (head + size) % PIPE_SIZE;
+        auto first = std::min(n, PIPE_SIZE - tail);
+        std::memcpy(buf.data() + tail, data, first);
+        std::memcpy(buf.data(), data + first, n - first);
+        size += n;
+        return n;
+    }
+
+    uint32_t cvm::pipe_t::read(byte *data, uint32_t n) {
+        n = std::min(n, size);
+        auto first = std::min(n, PIPE_SIZE - head);
+        std::memcpy(data, buf.data() + head, first);
+        std::memcpy(data + first, buf.data(), n - first);
+        head = (head + n) % PIPE_SIZE;
+        size -= n;
+        return n;
+    }
+
+    void cvm::pipe_t::reset() {
+        std::vector<byte>().swap(buf);
+        head = size = 0;
+        closed = false;
+        readers.clear();
+        writers.clear();
+    }
+
+    uint32_t cvm::pipe_in(pipe_t &p, uint32_t va, uint32_t n) {
+        uint32_t total = 0;
+        while (n > 0 && p.space() > 0) {
+            uint32_t left;
+            auto s = vmm_page(va, left, false);
+            auto k = p.write(s, std::min(left, n));
+            va += k;
+            n -= k;
+            total += k;
+        }
+        return total;
+    }
+
+    uint32_t cvm::pipe_out(pipe_t &p, uint32_t va, uint32_t n) {
+        uint32_t total = 0;
+        while (n > 0 && p.size > 0) {
+            uint32_t left;
+            auto d = vmm_page(va, left, true);
+            auto k = p.read(d, std::min(left, n));
+            va += k;
+            n -= k;
+            total += k;
+        }
+        return total;
+    }
+
+    // 并行执行：取出本轮全部就绪进程，各进程的用户态指令由线程池并行执行，
+    // 遇到中断、退出、编译等内核操作即停下；之后按原顺序在本线程串行执行剩余时间片
+    void cvm::run_parallel(int cycle, int &cycles) {
+        struct slice_t {
+            int id;
+            int quota;
+            int used;
+            bool kernel;
+            std::exception_ptr error;
+        };
+        std::vector<slice_t> slices;
+        for (auto level = 0; level < PRIORITY_NUM; ++level) {
+            auto &queue = ready_queue[level];
+            while (!queue.empty()) {
+                auto &c = tasks[queue.front()];
+                queue.pop_front();
+                if (!(c.flag & CTX_VALID) || c.state != CTS_RUNNING) {
+                    c.queued = false;
+                    continue;
+                }
+                if (c.priority != level) {
+                    ready_queue[c.priority].push_back(c.id);
+                    continue;
+                }
+                slices.push_back({c.id, slice(c, cycle), 0, false, nullptr});
+            }
+        }
+        workers->run((int) slices.size(), [&](int i) {
+            auto &s = slices[i];
+            ctx = &tasks[s.id];
+            try {
+                s.kernel = exec_threaded(s.quota, s.used, nullptr, true);
+            } catch (...) {
+                s.error = std::current_exception();
+            }
+            ctx = nullptr;
+        });
+        for (auto &s : slices) {
+            if (s.error)
+                std::rethrow_exception(s.error);
+        }
+        for (auto &s : slices) {
+            auto &c = tasks[s.id];
+            if (s.kernel && (c.flag & CTX_VALID) && c.state == CTS_RUNNING) {
+                ctx = &c;
+                exec_threaded(std::max(s.quota - s.used * 2, 2), s.used);
+            }
+            cycles += s.used;
+            ins_total += s.used;
+        }
+        for (auto &s : slices) {
+            auto &c = tasks[s.id];
+            if ((c.flag & CTX_VALID) && c.state == CTS_RUNNING)
+                ready_queue[c.priority].push_back(c.id);
+            else
+                c.queued = false;
+        }
+    }
+
     void cvm::exec(int cycle, int &cycles) {
         if (!ctx)
             error("no process!");
@@ -307,14 +924,7 @@ namespace clib {
             i++;
             cycles++;
             if (global_state.interrupt) break;
-            if ((ctx->pc & 0xF0000000) != USER_BASE) {
-                if (ctx->pc != 0xE0000FF4 && ctx->pc != 0xE0000FFC) {
-#if LOG_SYSTEM
-                    printf("[SYSTEM] ERR  | Invalid PC: %p\n", (void *) ctx->pc);
-#endif
-                    error("only code segment can execute");
-                }
-            }
+            // 代码已在载入时校验，顺序执行与静态跳转不会越界，只需检查CALL/LEV的动态目标
             auto op = vmm_get(ctx->pc); // get next operation code
             ctx->pc += INC_PTR;
 
@@ -350,127 +960,22 @@ namespace clib {
                 } /* load immediate value to ctx->ax._i */
                     break;
                 case LOAD: {
-                    auto n = vmm_get(ctx->pc);
-                    if (n <= 8) {
-                        switch (n) {
-                            case 1:
-                                ctx->ax._i = vmm_get<byte>((uint32_t) ctx->ax._i);
-                                break;
-                            case 2:
-                            case 3:
-                            case 4:
-                                ctx->ax._i = vmm_get((uint32_t) ctx->ax._i);
-                                break;
-                            case 8:
-                                ctx->ax._uq = vmm_get<uint64>((uint32_t) ctx->ax._i);
-                                break;
-                            default:
-                                error("load: not supported");
-                                break;
-                        }
-                    } else if (n <= BIG_DATA_NUM) {
-                        auto addr = (uint32_t) ctx->ax._i;
-                        for (auto j = 0; j < n / 4; ++j) {
-                            *((int*) &ctx->ax.big_data[j * 4]) = vmm_get((addr) + j * 4);
-                        }
-                        if (n % 4 != 0) {
-                            *((int*) &ctx->ax.big_data[n & ~3]) = vmm_get((addr) + (n & ~3));
-                            memset(&ctx->ax.big_data[n], 0, (size_t) (4 - (n % 3)));
-                        }
-                    } else {
-                        error("load: not supported big data");
-                    }
+                    load_ax(vmm_get(ctx->pc));
                     ctx->pc += INC_PTR;
                 } /* load integer to ctx->ax._i, address in ctx->ax._i */
                     break;
                 case SAVE: {
-                    auto n = vmm_get(ctx->pc);
-                    if (n <= 8) {
-                        switch (n) {
-                            case 1:
-                                vmm_set<byte>((uint32_t) vmm_popstack(ctx->sp), (byte) ctx->ax._i);
-                                break;
-                            case 2:
-                            case 3:
-                            case 4:
-                                vmm_set((uint32_t) vmm_popstack(ctx->sp), ctx->ax._i);
-                                break;
-                            case 8:
-                                vmm_set((uint32_t) vmm_popstack(ctx->sp), ctx->ax._uq);
-                                break;
-                            default:
-                                error("save: not supported");
-                                break;
-                        }
-                    } else if (n <= BIG_DATA_NUM) {
-                        auto addr = (uint32_t) vmm_popstack(ctx->sp);
-                        for (auto j = 0; j < n / 4; ++j) {
-                            vmm_set(addr + j * 4, *((uint32_t*) &ctx->ax.big_data[j * 4]));
-                        }
-                        if (n % 4 != 0) {
-                            memset(&ctx->ax.big_data[n], 0, (size_t) (4 - (n % 3)));
-                            vmm_set(addr + (n & ~3), *((uint32_t*) &ctx->ax.big_data[n & ~3]));
-                        }
-                    } else {
-                        error("save: not supported big data");
-                    }
+                    save_ax(vmm_get(ctx->pc));
                     ctx->pc += INC_PTR;
                 } /* save integer to address, value in ctx->ax._i, address on stack */
                     break;
                 case PUSH: {
-                    auto n = vmm_get(ctx->pc);
-                    if (n <= 8) {
-                        switch (n) {
-                            case 4:
-                                vmm_pushstack(ctx->sp, ctx->ax._i);
-                                break;
-                            case 8:
-                                vmm_pushstack(ctx->sp, ctx->ax._u._2);
-                                vmm_pushstack(ctx->sp, ctx->ax._u._1);
-                                break;
-                            default:
-                                error("push: not supported");
-                                break;
-                        }
-                    } else if (n <= BIG_DATA_NUM) {
-                        if (n % 4 != 0) {
-                            memset(&ctx->ax.big_data[n], 0, (size_t) (4 - (n % 3)));
-                            vmm_pushstack(ctx->sp, *((uint32_t*) &ctx->ax.big_data[n & ~3]));
-                        }
-                        for (auto j = n / 4 - 1; j >= 0; --j) {
-                            vmm_pushstack(ctx->sp, *((uint32_t*) &ctx->ax.big_data[j * 4]));
-                        }
-                    } else {
-                        error("push: not supported big data");
-                    }
+                    push_ax(vmm_get(ctx->pc));
                     ctx->pc += INC_PTR;
                 } /* push the value of ctx->ax._i onto the stack */
                     break;
                 case POP: {
-                    auto n = vmm_get(ctx->pc);
-                    if (n <= 8) {
-                        switch (n) {
-                            case 4:
-                                ctx->ax._i = vmm_popstack(ctx->sp);
-                                break;
-                            case 8:
-                                ctx->ax._q = vmm_popstack<int64>(ctx->sp);
-                                break;
-                            default:
-                                error("pop: not supported");
-                                break;
-                        }
-                    } else if (n <= BIG_DATA_NUM) {
-                        for (auto j = 0; j < n / 4; ++j) {
-                            *((uint32_t*) &ctx->ax.big_data[j * 4]) = vmm_popstack<uint32_t>(ctx->sp);
-                        }
-                        if (n % 4 != 0) {
-                            *((uint32_t*) &ctx->ax.big_data[n & ~3]) = vmm_popstack<uint32_t>(ctx->sp);
-                            memset(&ctx->ax.big_data[n], 0, (size_t) (4 - (n % 3)));
-                        }
-                    } else {
-                        error("pop: not supported big data");
-                    }
+                    pop_ax(vmm_get(ctx->pc));
                     ctx->pc += INC_PTR;
                 } /* pop the value of ctx->ax._i from the stack */
                     break;
@@ -489,6 +994,7 @@ namespace clib {
                 case CALL: {
                     vmm_pushstack(ctx->sp, ctx->pc);
                     ctx->pc = ctx->base + (ctx->ax._ui) * INC_PTR;
+                    check_pc(ctx->pc);
                 } /* call subroutine */
                     /* break;case RET: {pc = (int *)*sp++;} // return from subroutine; */
                     break;
@@ -508,6 +1014,7 @@ namespace clib {
                     ctx->sp = ctx->bp;
                     ctx->bp = (uint32_t) vmm_popstack(ctx->sp);
                     ctx->pc = (uint32_t) vmm_popstack(ctx->sp);
+                    check_pc(ctx->pc);
                 } /* restore call frame and PC */
                     break;
                 case LEA: {
@@ -1075,46 +1582,1482 @@ namespace clib {
 #if LOG_SYSTEM
                     printf("[SYSTEM] PROC | Exit: PID= #%d, CODE= %d\n", ctx->id, ctx->ax._i);
 #endif
-                    destroy(ctx->id);
-                    return;
-                }
-                case INTR: // 中断调用，以寄存器ax传参
-                    if (interrupt())
-                        return;
-                    break;
-                case CAST: // 类型转换，以寄存器ax传参
-                    cast();
-                    break;
-                default: {
+                    destroy(ctx->id);
+                    return;
+                }
+                case INTR: // 中断调用，以寄存器ax传参
+                    if (interrupt())
+                        return;
+                    break;
+                case CAST: // 类型转换，以寄存器ax传参
+                    cast();
+                    break;
+                default: {
+#if LOG_SYSTEM
+                    printf("[SYSTEM] ERR  | AX: %08X BP: %08X SP: %08X PC: %08X\n", ctx->ax._i, ctx->bp, ctx->sp, ctx->pc);
+                    for (uint32_t j = ctx->sp; j < STACK_TOP; j += 4) {
+                        printf("[SYSTEM] ERR  | [%08X]> %08X\n", j, vmm_get<uint32_t>(j));
+                    }
+                    printf("[SYSTEM] ERR  | unknown instruction: %d\n", op);
+#endif
+                    error("unknown instruction");
+                }
+            }
+
+#if LOG_STACK
+            if (ctx->debug) {
+                printf("\n---------------- STACK BEGIN <<<< \n");
+                printf("AX: %08X BX: %08X BP: %08X SP: %08X PC: %08X\n", ctx->ax._u._1, ctx->ax._u._2, ctx->bp, ctx->sp, ctx->pc);
+                auto k = 0;
+                for (uint32_t j = ctx->sp; j < STACK_TOP; j += 4, ++k) {
+                    printf("[%08X]> %08X", j, vmm_get<uint32_t>(j));
+                    if (k % 4 == 3)
+                        printf("\n");
+                    else
+                        printf("  |  ");
+                }
+                if (k % 4 != 0)
+                    printf("\n");
+                printf("---------------- STACK END >>>>\n\n");
+            }
+#endif
+        }
+    }
+
+    void cvm::load_ax(int n) {
+        if (n <= 8) {
+            switch (n) {
+                case 1:
+                    ctx->ax._i = vmm_get<byte>((uint32_t) ctx->ax._i);
+                    break;
+                case 2:
+                case 3:
+                case 4:
+                    ctx->ax._i = vmm_get((uint32_t) ctx->ax._i);
+                    break;
+                case 8:
+                    ctx->ax._uq = vmm_get<uint64>((uint32_t) ctx->ax._i);
+                    break;
+                default:
+                    error("load: not supported");
+                    break;
+            }
+        } else if (n <= BIG_DATA_NUM) {
+            auto addr = (uint32_t) ctx->ax._i;
+            for (auto j = 0; j < n / 4; ++j) {
+                *((int*) &ctx->ax.big_data[j * 4]) = vmm_get((addr) + j * 4);
+            }
+            if (n % 4 != 0) {
+                *((int*) &ctx->ax.big_data[n & ~3]) = vmm_get((addr) + (n & ~3));
+                memset(&ctx->ax.big_data[n], 0, (size_t) (4 - (n % 3)));
+            }
+        } else {
+            error("load: not supported big data");
+        }
+    }
+
+    void cvm::save_ax(int n) {
+        if (n <= 8) {
+            switch (n) {
+                case 1:
+                    vmm_set<byte>((uint32_t) vmm_popstack(ctx->sp), (byte) ctx->ax._i);
+                    break;
+                case 2:
+                case 3:
+                case 4:
+                    vmm_set((uint32_t) vmm_popstack(ctx->sp), ctx->ax._i);
+                    break;
+                case 8:
+                    vmm_set((uint32_t) vmm_popstack(ctx->sp), ctx->ax._uq);
+                    break;
+                default:
+                    error("save: not supported");
+                    break;
+            }
+        } else if (n <= BIG_DATA_NUM) {
+            auto addr = (uint32_t) vmm_popstack(ctx->sp);
+            for (auto j = 0; j < n / 4; ++j) {
+                vmm_set(addr + j * 4, *((uint32_t*) &ctx->ax.big_data[j * 4]));
+            }
+            if (n % 4 != 0) {
+                memset(&ctx->ax.big_data[n], 0, (size_t) (4 - (n % 3)));
+                vmm_set(addr + (n & ~3), *((uint32_t*) &ctx->ax.big_data[n & ~3]));
+            }
+        } else {
+            error("save: not supported big data");
+        }
+    }
+
+    void cvm::push_ax(int n) {
+        if (n <= 8) {
+            switch (n) {
+                case 4:
+                    vmm_pushstack(ctx->sp, ctx->ax._i);
+                    break;
+                case 8:
+                    vmm_pushstack(ctx->sp, ctx->ax._u._2);
+                    vmm_pushstack(ctx->sp, ctx->ax._u._1);
+                    break;
+                default:
+                    error("push: not supported");
+                    break;
+            }
+        } else if (n <= BIG_DATA_NUM) {
+            if (n % 4 != 0) {
+                memset(&ctx->ax.big_data[n], 0, (size_t) (4 - (n % 3)));
+                vmm_pushstack(ctx->sp, *((uint32_t*) &ctx->ax.big_data[n & ~3]));
+            }
+            for (auto j = n / 4 - 1; j >= 0; --j) {
+                vmm_pushstack(ctx->sp, *((uint32_t*) &ctx->ax.big_data[j * 4]));
+            }
+        } else {
+            error("push: not supported big data");
+        }
+    }
+
+    void cvm::pop_ax(int n) {
+        if (n <= 8) {
+            switch (n) {
+                case 4:
+                    ctx->ax._i = vmm_popstack(ctx->sp);
+                    break;
+                case 8:
+                    ctx->ax._q = vmm_popstack<int64>(ctx->sp);
+                    break;
+                default:
+                    error("pop: not supported");
+                    break;
+            }
+        } else if (n <= BIG_DATA_NUM) {
+            for (auto j = 0; j < n / 4; ++j) {
+                *((uint32_t*) &ctx->ax.big_data[j * 4]) = vmm_popstack<uint32_t>(ctx->sp);
+            }
+            if (n % 4 != 0) {
+                *((uint32_t*) &ctx->ax.big_data[n & ~3]) = vmm_popstack<uint32_t>(ctx->sp);
+                memset(&ctx->ax.big_data[n], 0, (size_t) (4 - (n % 3)));
+            }
+        } else {
+            error("pop: not supported big data");
+        }
+    }
+
+    // 载入前校验目标文件，不合法的直接拒绝，返回指令边界
+    // 校验：文件头与长度，操作码范围，操作数完整，跳转目标与CALL立即数落在指令边界，末条指令不会顺序越界
+    std::vector<bool> cvm::verify(const std::vector<byte> &file, std::vector<uint32_t> &text) const {
+        auto header = (uint32_t) offsetof(PE, data);
+        if (file.size() < header)
+            error("invalid image: file too small");
+        auto pe = (const PE *) file.data();
+        if (std::memcmp(pe->magic, PE_MAGIC, sizeof(pe->magic)) != 0)
+            error("invalid image: bad magic");
+        if ((uint64) header + pe->data_len + pe->text_len > file.size() || pe->text_len == 0)
+            error("invalid image: bad segment size");
+        auto code = file.data() + header + pe->data_len;
+        if (pe->flags & PE_COMPACT) {
+            if (!cgen::unpack(code, pe->text_len, text))
+                error("invalid image: bad compact text");
+        } else {
+            if (pe->text_len % sizeof(uint32_t) != 0)
+                error("invalid image: bad segment size");
+            text.resize(pe->text_len / sizeof(uint32_t));
+            std::memcpy(text.data(), code, pe->text_len);
+        }
+        auto n = (uint32_t) text.size();
+        std::vector<bool> boundary(n);
+        auto fail = [&](const char *msg, uint32_t i) {
+#if LOG_SYSTEM
+            printf("[SYSTEM] ERR  | Verify: %s, INS= %d, OP= %d\n", msg, i, i < n ? text[i] : -1);
+#endif
+            error(string_t("invalid image: ") + msg);
+        };
+        auto last = NOP;
+        for (uint32_t i = 0; i < n;) {
+            if (text[i] > EXIT)
+                fail("unknown instruction", i);
+            last = (ins_t) text[i];
+            auto len = (uint32_t) INS_LEN(last);
+            if (i + len > n)
+                fail("missing operand", i);
+            boundary[i] = true;
+            i += len;
+        }
+        if (last != JMP && last != LEV && last != EXIT)
+            fail("code runs past end of text", n);
+        auto is_ins = [&](uint32_t t) { return t < n && boundary[t]; };
+        if (!is_ins(pe->entry) || text[pe->entry] != ENT)
+            fail("invalid entry", pe->entry);
+        for (uint32_t i = 0; i < n; ++i) {
+            if (!boundary[i])
+                continue;
+            switch (text[i]) {
+                case JMP:
+                case JZ:
+                case JNZ:
+                    if (!is_ins(text[i + 1]))
+                        fail("invalid jump target", i);
+                    break;
+                case IMM:
+                    if (is_ins(i + 2) && text[i + 2] == CALL &&
+                        (!is_ins(text[i + 1]) || text[text[i + 1]] != ENT))
+                        fail("invalid call target", i);
+                    break;
+                default:
+                    break;
+            }
+        }
+        return boundary;
+    }
+
+    // 动态跳转目标（CALL/LEV）须为代码段中的指令边界，或栈上的退出桩
+    void cvm::check_pc(uint32_t pc) const {
+        if (pc == STACK_TOP - INC_PTR * 3 || pc == STACK_TOP - INC_PTR)
+            return;
+        auto idx = (pc - ctx->base) / INC_PTR;
+        const auto &b = ctx->code->boundary;
+        if ((pc & (INC_PTR - 1)) == 0 && pc >= ctx->base && idx < b.size() && b[idx])
+            return;
+#if LOG_SYSTEM
+        printf("[SYSTEM] ERR  | Invalid PC: %08X\n", pc);
+#endif
+        error("only code segment can execute");
+    }
+
+    // 预解码：每个代码字对应一项，操作数提前取出，处理例程地址直接填好
+    // 按字而非按指令解码，故任意合法PC（含跳入操作数位置的情况）都与switch执行一致
+    // 内容相同的代码段共用一份映像（含已编译的本地代码）
+    void cvm::decode(const uint32_t *text, uint32_t size, std::vector<bool> &&boundary) {
+        profile(text, size);
+        auto hash = image_hash(text, size);
+        auto cached = image_cache.find(hash);
+        if (cached != image_cache.end()) {
+            auto code = cached->second.lock();
+            if (code && code->text.size() == size && std::equal(text, text + size, code->text.begin())) {
+                ctx->code = code;
+                return;
+            }
+            if (!code)
+                image_cache.erase(cached); // 映像已无进程引用，清除失效项
+        }
+        const void *const *table = nullptr;
+        int dummy = 0;
+        exec_threaded(0, dummy, &table);
+        auto code = std::make_shared<image_t>();
+        code->text.assign(text, text + size);
+        code->boundary = std::move(boundary);
+        code->ins.resize(size);
+        code->calls = std::vector<std::atomic<int>>(size);
+        for (uint32_t i = 0; i < size; ++i) {
+            auto &d = code->ins[i];
+            d.op = (int) text[i];
+            d.arg1 = i + 1 < size ? (int) text[i + 1] : 0;
+            d.arg2 = i + 2 < size ? (int) text[i + 2] : 0;
+            if (table)
+                d.handler = d.op >= NOP && d.op <= EXIT ? table[d.op] : table[INS_END];
+            else
+                d.handler = nullptr;
+        }
+        if (table) {
+            for (uint32_t i = 0; i + 1 < size; ++i) {
+                auto f = specialize((int) text[i], (int) text[i + 1]);
+                if (f != NOP)
+                    code->ins[i].handler = table[f];
+            }
+            for (uint32_t i = 0; i < size; ++i) {
+                auto f = fuse(text, i, size);
+                if (f != NOP)
+                    code->ins[i].handler = table[f];
+            }
+        }
+        for (auto it = image_cache.begin(); it != image_cache.end();) {
+            if (it->second.expired())
+                it = image_cache.erase(it);
+            else
+                ++it;
+        }
+        image_cache[hash] = code;
+        ctx->code = code;
+    }
+
+    // FNV-1a
+    uint64 cvm::image_hash(const uint32_t *text, uint32_t size) {
+        uint64 h = 14695981039346656037ULL;
+        for (uint32_t i = 0; i < size; ++i) {
+            for (auto j = 0; j < 4; ++j) {
+                h ^= (text[i] >> (j * 8)) & 0xFFU;
+                h *= 1099511628211ULL;
+            }
+        }
+        return h;
+    }
+
+    // 超级指令改写：匹配从i开始的指令序列，返回对应的超级指令（无则为NOP）
+    // 逐字匹配，与指令边界无关，故融合后的语义与从i开始逐条执行完全一致
+    ins_t cvm::fuse(const uint32_t *text, uint32_t i, uint32_t size) {
+        auto at = [=](uint32_t k) { return i + k < size ? (int) text[i + k] : -1; };
+        auto lea_load = at(0) == LEA && at(2) == LOAD && at(3) == 4;
+        auto push = at(0) == PUSH && at(1) == 4;
+        if (lea_load && at(4) == PUSH && at(5) == 4)
+            return LEA_LOAD_PUSH;
+        if (push && at(2) == LEA && at(4) == LOAD && at(5) == 4)
+            return PUSH_LEA_LOAD;
+        if (push && at(2) == IMM && at(4) == ADD &&
+            (at(5) == t_char || at(5) == t_uchar || at(5) == t_short || at(5) == t_ushort ||
+             at(5) == t_int || at(5) == t_uint || at(5) == t_ptr))
+            return PUSH_IMM_ADD;
+        if (lea_load)
+            return LEA_LOAD;
+        if (at(0) == LEA && at(2) == PUSH && at(3) == 4)
+            return LEA_PUSH;
+        if (at(0) == LOAD && at(1) == 4 && at(2) == PUSH && at(3) == 4)
+            return LOAD_PUSH;
+        if (at(0) == IMM && at(2) == PUSH && at(3) == 4)
+            return IMM_PUSH;
+        if (at(0) == IMM && at(2) == CALL)
+            return IMM_CALL;
+        if (push && at(2) == IMM)
+            return PUSH_IMM;
+        if (push && at(2) == LEA)
+            return PUSH_LEA;
+        return NOP;
+    }
+
+    // 类型特化：按运算指令及其类型操作数选取特化指令（无则为NOP）
+    // 补码下有无符号的加减乘、按位运算与相等比较结果相同，故共用32位/64位整数版本
+    ins_t cvm::specialize(int op, int type) {
+#define SPEC_I32(o) \
+            case t_char: \
+            case t_short: \
+            case t_int: \
+                return o##_I32;
+#define SPEC_U32(o) \
+            case t_uchar: \
+            case t_ushort: \
+            case t_uint: \
+            case t_ptr: \
+                return o;
+#define SPEC_FLT(o) \
+            case t_float: \
+                return o##_F32; \
+            case t_double: \
+                return o##_F64;
+#define SPEC_END \
+            default: \
+                return NOP;
+
+        switch (op) {
+            case ADD:
+                switch ((cast_t) type) {
+                    SPEC_I32(ADD) SPEC_U32(ADD_I32) SPEC_FLT(ADD)
+                    case t_long:
+                    case t_ulong:
+                        return ADD_I64;
+                    SPEC_END
+                }
+            case SUB:
+                switch ((cast_t) type) {
+                    SPEC_I32(SUB) SPEC_U32(SUB_I32) SPEC_FLT(SUB)
+                    case t_long:
+                    case t_ulong:
+                        return SUB_I64;
+                    SPEC_END
+                }
+            case MUL:
+                switch ((cast_t) type) {
+                    SPEC_I32(MUL) SPEC_FLT(MUL)
+                    case t_uchar:
+                    case t_ushort:
+                    case t_uint:
+                        return MUL_I32;
+                    case t_long:
+                    case t_ulong:
+                        return MUL_I64;
+                    SPEC_END
+                }
+            case DIV:
+                switch ((cast_t) type) {
+                    SPEC_I32(DIV) SPEC_FLT(DIV)
+                    case t_long:
+                        return DIV_I64;
+                    SPEC_END
+                }
+            case MOD:
+                switch ((cast_t) type) { SPEC_I32(MOD) SPEC_END }
+            case SHR:
+                switch ((cast_t) type) { SPEC_I32(SHR) SPEC_END }
+            case OR:
+                switch ((cast_t) type) { SPEC_I32(OR) case t_uchar: case t_ushort: case t_uint: return OR_I32; SPEC_END }
+            case XOR:
+                switch ((cast_t) type) { SPEC_I32(XOR) case t_uchar: case t_ushort: case t_uint: return XOR_I32; SPEC_END }
+            case AND:
+                switch ((cast_t) type) { SPEC_I32(AND) case t_uchar: case t_ushort: case t_uint: return AND_I32; SPEC_END }
+            case SHL:
+                switch ((cast_t) type) { SPEC_I32(SHL) case t_uchar: case t_ushort: case t_uint: return SHL_I32; SPEC_END }
+            case EQ:
+                switch ((cast_t) type) { SPEC_I32(EQ) SPEC_U32(EQ_I32) case t_double: return EQ_F64; SPEC_END }
+            case NE:
+                switch ((cast_t) type) { SPEC_I32(NE) SPEC_U32(NE_I32) case t_double: return NE_F64; SPEC_END }
+            case LT:
+                switch ((cast_t) type) { SPEC_I32(LT) SPEC_U32(LT_U32) case t_double: return LT_F64; SPEC_END }
+            case GT:
+                switch ((cast_t) type) { SPEC_I32(GT) SPEC_U32(GT_U32) case t_double: return GT_F64; SPEC_END }
+            case LE:
+                switch ((cast_t) type) { SPEC_I32(LE) SPEC_U32(LE_U32) case t_double: return LE_F64; SPEC_END }
+            case GE:
+                switch ((cast_t) type) { SPEC_I32(GE) SPEC_U32(GE_U32) case t_double: return GE_F64; SPEC_END }
+            default:
+                return NOP;
+        }
+
+#undef SPEC_END
+#undef SPEC_FLT
+#undef SPEC_U32
+#undef SPEC_I32
+    }
+
+    // 静态统计载入程序中相邻两条、三条指令的出现次数
+    void cvm::profile(const uint32_t *text, uint32_t size) {
+        int prev[2] = {-1, -1};
+        for (uint32_t i = 0; i < size;) {
+            auto op = (int) text[i];
+            if (op < NOP || op > EXIT) {
+                prev[0] = prev[1] = -1;
+                i++;
+                continue;
+            }
+            if (prev[1] != -1) {
+                ins_pairs[(prev[1] << 8) | op]++;
+                if (prev[0] != -1)
+                    ins_triples[(prev[0] << 16) | (prev[1] << 8) | op]++;
+            }
+            prev[0] = prev[1];
+            prev[1] = op;
+            i += INS_LEN((ins_t) op);
+        }
+    }
+
+    // user为真时只执行用户态指令（并行阶段），遇到中断、退出等须内核处理的操作即停下，返回真
+    bool cvm::exec_threaded(int cycle, int &cycles, const void *const **table, bool user) {
+#if CVM_THREADED
+        static const void *const labels[] = {
+            &&_NOP, &&_LEA, &&_IMM, &&_IMX, &&_JMP, &&_JZ, &&_JNZ, &&_ENT, &&_LOAD, &&_SAVE, &&_INTR, &&_CAST,
+            &&_ADJ, &&_CALL, &&_LEV, &&_PUSH, &&_POP, &&_OR, &&_XOR, &&_AND, &&_EQ, &&_CASE, &&_NE, &&_LT,
+            &&_GT, &&_LE, &&_GE, &&_SHL, &&_SHR, &&_ADD, &&_SUB, &&_MUL, &&_DIV, &&_MOD, &&_NEG, &&_NOT,
+            &&_LNT, &&_EXIT,
+            &&_LEA_LOAD, &&_LEA_PUSH, &&_LOAD_PUSH, &&_IMM_PUSH, &&_PUSH_IMM, &&_PUSH_LEA, &&_IMM_CALL,
+            &&_LEA_LOAD_PUSH, &&_PUSH_LEA_LOAD, &&_PUSH_IMM_ADD,
+            &&_ADD_I32, &&_ADD_I64, &&_ADD_F32, &&_ADD_F64, &&_SUB_I32, &&_SUB_I64, &&_SUB_F32, &&_SUB_F64,
+            &&_MUL_I32, &&_MUL_I64, &&_MUL_F32, &&_MUL_F64, &&_DIV_I32, &&_DIV_I64, &&_DIV_F32, &&_DIV_F64,
+            &&_MOD_I32, &&_OR_I32, &&_XOR_I32, &&_AND_I32, &&_SHL_I32, &&_SHR_I32, &&_EQ_I32, &&_EQ_F64,
+            &&_NE_I32, &&_NE_F64, &&_LT_I32, &&_LT_U32, &&_LT_F64, &&_GT_I32, &&_GT_U32, &&_GT_F64,
+            &&_LE_I32, &&_LE_U32, &&_LE_F64, &&_GE_I32, &&_GE_U32, &&_GE_F64,
+            &&_INVALID, &&_NATIVE,
+        };
+        if (table) {
+            *table = labels;
+            return false;
+        }
+        if (!ctx)
+            error("no process!");
+        if (!ctx->code) {
+            if (user)
+                return true;
+            exec(cycle, cycles);
+            return false;
+        }
+        auto &image = *ctx->code;
+        const auto *code = image.ins.data();
+        const auto code_size = (uint32_t) image.ins.size();
+        const ins_dec_t *ins;
+        uint32_t idx;
+        auto budget = (cycle + 1) / 2; // 与exec一致，每两个周期执行一条指令
+        // 常用寄存器放在局部变量中，仅在时间片结束、中断、调用内核函数时与上下文同步
+        const auto base = ctx->base;
+        auto pc = ctx->pc;
+        auto sp = ctx->sp;
+        auto bp = ctx->bp;
+        union {
+            int _i;
+            uint _ui;
+            float _f;
+            double _d;
+            int64 _q;
+            uint64 _uq;
+            struct {
+                int _1, _2;
+            } _u;
+        } ax;
+        std::memcpy(&ax, &ctx->ax, sizeof(ax));
+        uint64 fused = 0;
+
+#define STORE_REGS() \
+        do { \
+            ctx->pc = pc; \
+            ctx->sp = sp; \
+            ctx->bp = bp; \
+            std::memcpy(&ctx->ax, &ax, sizeof(ax)); \
+            if (fused) { \
+                ins_fused += fused; \
+                fused = 0; \
+            } \
+        } while (0)
+
+// 撤销本次分派，留给串行阶段由内核处理
+#define DEFER() \
+        do { \
+            pc -= INC_PTR; \
+            cycles--; \
+            STORE_REGS(); \
+            return true; \
+        } while (0)
+
+#define LOAD_REGS() \
+        do { \
+            pc = ctx->pc; \
+            sp = ctx->sp; \
+            bp = ctx->bp; \
+            std::memcpy(&ax, &ctx->ax, sizeof(ax)); \
+        } while (0)
+
+#define DISPATCH() \
+        do { \
+            if (--budget < 0 || global_state.interrupt) goto _END; \
+            idx = (pc - USER_BASE) / INC_PTR; \
+            if (idx >= code_size) goto _OUTSIDE; \
+            cycles++; \
+            ins = &code[idx]; \
+            pc += INC_PTR; \
+            goto *ins->handler; \
+        } while (0)
+
+#define FUSED(n) \
+        do { \
+            fused += (n) - 1; \
+            cycles += (n) - 1; \
+        } while (0)
+
+#define OP_SPEC(name, T, f, o) \
+        _##name: \
+        ax.f = vmm_popstack<T>(sp) o ax.f; \
+        pc += INC_PTR; \
+        DISPATCH();
+
+#define OP_SPEC_CMP(name, T, f, o) \
+        _##name: \
+        ax._i = vmm_popstack<T>(sp) o ax.f; \
+        pc += INC_PTR; \
+        DISPATCH();
+
+#define OP_SPEC_DIV(name, T, f) \
+        _##name: \
+        if (ax.f == 0) \
+            error("divide zero exception"); \
+        ax.f = vmm_popstack<T>(sp) / ax.f; \
+        pc += INC_PTR; \
+        DISPATCH();
+
+#define OP_INT(o) \
+            case t_char: \
+            case t_short: \
+            case t_int: \
+                ax._i = vmm_popstack(sp) o ax._i; \
+                break; \
+            case t_uchar: \
+            case t_ushort: \
+            case t_uint: \
+                ax._ui = vmm_popstack<uint>(sp) o ax._ui; \
+                break; \
+            case t_long: \
+                ax._q = vmm_popstack<int64>(sp) o ax._q; \
+                break; \
+            case t_ulong: \
+                ax._uq = vmm_popstack<uint64>(sp) o ax._uq; \
+                break;
+
+#define OP_FLT(o) \
+            case t_float: \
+                ax._f = vmm_popstack<float>(sp) o ax._f; \
+                break; \
+            case t_double: \
+                ax._d = vmm_popstack<double>(sp) o ax._d; \
+                break;
+
+#define OP_PTR(o) \
+            case t_ptr: \
+                ax._ui = vmm_popstack<uint>(sp) o (uint) ax._i; \
+                break;
+
+#define OP_CMP(o) \
+            case t_char: \
+            case t_short: \
+            case t_int: \
+                ax._i = vmm_popstack(sp) o ax._i; \
+                break; \
+            case t_uchar: \
+            case t_ushort: \
+            case t_uint: \
+            case t_ptr: \
+                ax._i = vmm_popstack<uint>(sp) o ax._ui; \
+                break; \
+            case t_long: \
+                ax._i = vmm_popstack<int64>(sp) o ax._q; \
+                break; \
+            case t_ulong: \
+                ax._i = vmm_popstack<uint64>(sp) o ax._uq; \
+                break; \
+            case t_float: \
+                ax._i = vmm_popstack<float>(sp) o ax._f; \
+                break; \
+            case t_double: \
+                ax._i = vmm_popstack<double>(sp) o ax._d; \
+                break;
+
+#define OP_END \
+            default: \
+                error("unsupport operator: " + INS_STRING((ins_t) ins->op)); \
+                break;
+
+        DISPATCH();
+
+        _NOP:
+        DISPATCH();
+        _IMM:
+        ax._i = ins->arg1;
+        pc += INC_PTR;
+        DISPATCH();
+        _IMX:
+        ax._u._1 = ins->arg1;
+        ax._u._2 = ins->arg2;
+        pc += INC_PTR * 2;
+        DISPATCH();
+        _LOAD:
+        if (ins->arg1 == 4)
+            ax._i = vmm_get((uint32_t) ax._i);
+        else {
+            STORE_REGS();
+            load_ax(ins->arg1);
+            LOAD_REGS();
+        }
+        pc += INC_PTR;
+        DISPATCH();
+        _SAVE:
+        if (ins->arg1 == 4)
+            vmm_set((uint32_t) vmm_popstack(sp), ax._i);
+        else {
+            STORE_REGS();
+            save_ax(ins->arg1);
+            LOAD_REGS();
+        }
+        pc += INC_PTR;
+        DISPATCH();
+        _PUSH:
+        if (ins->arg1 == 4)
+            vmm_pushstack(sp, ax._i);
+        else {
+            STORE_REGS();
+            push_ax(ins->arg1);
+            LOAD_REGS();
+        }
+        pc += INC_PTR;
+        DISPATCH();
+        _POP:
+        if (ins->arg1 == 4)
+            ax._i = vmm_popstack(sp);
+        else {
+            STORE_REGS();
+            pop_ax(ins->arg1);
+            LOAD_REGS();
+        }
+        pc += INC_PTR;
+        DISPATCH();
+        _JMP:
+        pc = base + ins->arg1 * INC_PTR;
+        DISPATCH();
+        _JZ:
+        pc = ax._i ? pc + INC_PTR : (base + ins->arg1 * INC_PTR);
+        DISPATCH();
+        _JNZ:
+        pc = ax._i ? (base + ins->arg1 * INC_PTR) : pc + INC_PTR;
+        DISPATCH();
+        _CALL:
+        vmm_pushstack(sp, pc);
+        pc = base + (ax._ui) * INC_PTR;
+        check_pc(pc);
+        DISPATCH();
+        _ENT:
+        if (global_state.exec_mode == EXEC_JIT &&
+            image.calls[idx].load(std::memory_order_relaxed) < JIT_THRESHOLD &&
+            image.calls[idx].fetch_add(1, std::memory_order_relaxed) + 1 >= JIT_THRESHOLD) {
+            if (user) {
+                // 编译须串行进行：计数退回，由串行阶段重新执行本条指令时编译
+                image.calls[idx].store(JIT_THRESHOLD - 1, std::memory_order_relaxed);
+                DEFER();
+            }
+            jit_compile(idx); // 本次仍解释执行，下次调用进入本地代码
+        }
+        vmm_pushstack(sp, bp);
+        bp = sp;
+        sp = sp - ins->arg1;
+        pc += INC_PTR;
+        DISPATCH();
+        _ADJ:
+        sp = sp + ins->arg1 * INC_PTR;
+        pc += INC_PTR;
+        DISPATCH();
+        _LEV:
+        sp = bp;
+        bp = (uint32_t) vmm_popstack(sp);
+        pc = (uint32_t) vmm_popstack(sp);
+        check_pc(pc);
+        DISPATCH();
+        _LEA:
+        ax._i = bp + ins->arg1;
+        pc += INC_PTR;
+        DISPATCH();
+        _CASE:
+        if (vmm_get(sp) == ax._i) {
+            sp += INC_PTR;
+            ax._i = 0; // 0 for same
+        } else {
+            ax._i = 1;
+        }
+        DISPATCH();
+        _OR:
+        switch ((cast_t) ins->arg1) { OP_INT(|) OP_END }
+        pc += INC_PTR;
+        DISPATCH();
+        _XOR:
+        switch ((cast_t) ins->arg1) { OP_INT(^) OP_END }
+        pc += INC_PTR;
+        DISPATCH();
+        _AND:
+        switch ((cast_t) ins->arg1) { OP_INT(&) OP_END }
+        pc += INC_PTR;
+        DISPATCH();
+        _EQ:
+        switch ((cast_t) ins->arg1) { OP_CMP(==) OP_END }
+        pc += INC_PTR;
+        DISPATCH();
+        _NE:
+        switch ((cast_t) ins->arg1) { OP_CMP(!=) OP_END }
+        pc += INC_PTR;
+        DISPATCH();
+        _LT:
+        switch ((cast_t) ins->arg1) { OP_CMP(<) OP_END }
+        pc += INC_PTR;
+        DISPATCH();
+        _LE:
+        switch ((cast_t) ins->arg1) { OP_CMP(<=) OP_END }
+        pc += INC_PTR;
+        DISPATCH();
+        _GT:
+        switch ((cast_t) ins->arg1) { OP_CMP(>) OP_END }
+        pc += INC_PTR;
+        DISPATCH();
+        _GE:
+        switch ((cast_t) ins->arg1) { OP_CMP(>=) OP_END }
+        pc += INC_PTR;
+        DISPATCH();
+        _SHL:
+        switch ((cast_t) ins->arg1) { OP_INT(<<) OP_END }
+        pc += INC_PTR;
+        DISPATCH();
+        _SHR:
+        switch ((cast_t) ins->arg1) { OP_INT(>>) OP_END }
+        pc += INC_PTR;
+        DISPATCH();
+        _ADD:
+        switch ((cast_t) ins->arg1) { OP_INT(+) OP_FLT(+) OP_PTR(+) OP_END }
+        pc += INC_PTR;
+        DISPATCH();
+        _SUB:
+        switch ((cast_t) ins->arg1) { OP_INT(-) OP_FLT(-) OP_PTR(-) OP_END }
+        pc += INC_PTR;
+        DISPATCH();
+        _MUL:
+        switch ((cast_t) ins->arg1) { OP_INT(*) OP_FLT(*) OP_END }
+        pc += INC_PTR;
+        DISPATCH();
+        _DIV:
+        switch ((cast_t) ins->arg1) {
+            case t_char:
+            case t_short:
+            case t_int:
+                if (ax._i == 0)
+                    error("divide zero exception");
+                ax._i = vmm_popstack(sp) / ax._i;
+                break;
+            case t_uchar:
+            case t_ushort:
+            case t_uint:
+                if (ax._ui == 0)
+                    error("divide zero exception");
+                ax._ui = vmm_popstack<uint>(sp) / ax._ui;
+                break;
+            case t_long:
+                if (ax._q == 0)
+                    error("divide zero exception");
+                ax._q = vmm_popstack<int64>(sp) / ax._q;
+                break;
+            case t_ulong:
+                if (ax._uq == 0)
+                    error("divide zero exception");
+                ax._uq = vmm_popstack<uint64>(sp) / ax._uq;
+                break;
+            case t_float:
+                if (ax._f == 0)
+                    error("divide zero exception");
+                ax._f = vmm_popstack<float>(sp) / ax._f;
+                break;
+            case t_double:
+                if (ax._d == 0)
+                    error("divide zero exception");
+                ax._d = vmm_popstack<double>(sp) / ax._d;
+                break;
+            OP_END
+        }
+        pc += INC_PTR;
+        DISPATCH();
+        _MOD:
+        switch ((cast_t) ins->arg1) { OP_INT(%) OP_END }
+        pc += INC_PTR;
+        DISPATCH();
+        _NEG:
+        switch ((cast_t) ins->arg1) {
+            case t_char:
+            case t_short:
+            case t_int:
+                ax._i = -ax._i;
+                break;
+            case t_long:
+                ax._q = -ax._q;
+                break;
+            case t_float:
+                ax._f = -ax._f;
+                break;
+            case t_double:
+                ax._d = -ax._d;
+                break;
+            OP_END
+        }
+        pc += INC_PTR;
+        DISPATCH();
+        _NOT:
+        switch ((cast_t) ins->arg1) {
+            case t_char:
+            case t_short:
+            case t_int:
+                ax._i = ~ax._i;
+                break;
+            case t_uchar:
+            case t_ushort:
+            case t_uint:
+                ax._ui = ~ax._ui;
+                break;
+            case t_long:
+                ax._q = ~ax._q;
+                break;
+            case t_ulong:
+                ax._uq = ~ax._uq;
+                break;
+            OP_END
+        }
+        pc += INC_PTR;
+        DISPATCH();
+        _LNT:
+        switch ((cast_t) ins->arg1) {
+            case t_char:
+            case t_short:
+            case t_int:
+                ax._i = ax._i ? 0 : 1;
+                break;
+            case t_uchar:
+            case t_ushort:
+            case t_uint:
+            case t_ptr:
+                ax._i = ax._ui ? 0 : 1;
+                break;
+            case t_long:
+                ax._i = ax._q ? 0 : 1;
+                break;
+            case t_ulong:
+                ax._i = ax._uq ? 0 : 1;
+                break;
+            case t_float:
+                ax._i = ax._f == 0.0f ? 0 : 1;
+                break;
+            case t_double:
+                ax._i = ax._d == 0 ? 0 : 1;
+                break;
+            OP_END
+        }
+        pc += INC_PTR;
+        DISPATCH();
+        _EXIT:
+        if (user)
+            DEFER();
+#if LOG_SYSTEM
+        printf("[SYSTEM] PROC | Exit: PID= #%d, CODE= %d\n", ctx->id, ax._i);
+#endif
+        STORE_REGS();
+        destroy(ctx->id);
+        return false;
+        _INTR:
+        if (user)
+            DEFER();
+        STORE_REGS();
+        if (interrupt())
+            return false;
+        LOAD_REGS();
+        DISPATCH();
+        _CAST:
+        STORE_REGS();
+        cast();
+        LOAD_REGS();
+        DISPATCH();
+        // 超级指令：pc已指向首条指令之后，跳过其余部分
+        _LEA_LOAD:
+        ax._i = vmm_get((uint32_t) (bp + ins->arg1));
+        pc += INC_PTR * 3;
+        FUSED(2);
+        DISPATCH();
+        _LEA_PUSH:
+        ax._i = bp + ins->arg1;
+        vmm_pushstack(sp, ax._i);
+        pc += INC_PTR * 3;
+        FUSED(2);
+        DISPATCH();
+        _LOAD_PUSH:
+        ax._i = vmm_get((uint32_t) ax._i);
+        vmm_pushstack(sp, ax._i);
+        pc += INC_PTR * 3;
+        FUSED(2);
+        DISPATCH();
+        _IMM_PUSH:
+        ax._i = ins->arg1;
+        vmm_pushstack(sp, ax._i);
+        pc += INC_PTR * 3;
+        FUSED(2);
+        DISPATCH();
+        _PUSH_IMM:
+        vmm_pushstack(sp, ax._i);
+        ax._i = ins[2].arg1;
+        pc += INC_PTR * 3;
+        FUSED(2);
+        DISPATCH();
+        _PUSH_LEA:
+        vmm_pushstack(sp, ax._i);
+        ax._i = bp + ins[2].arg1;
+        pc += INC_PTR * 3;
+        FUSED(2);
+        DISPATCH();
+        _IMM_CALL:
+        ax._i = ins->arg1;
+        vmm_pushstack(sp, pc + INC_PTR * 2);
+        pc = base + (ax._ui) * INC_PTR;
+        FUSED(2);
+        DISPATCH();
+        _LEA_LOAD_PUSH:
+        ax._i = vmm_get((uint32_t) (bp + ins->arg1));
+        vmm_pushstack(sp, ax._i);
+        pc += INC_PTR * 5;
+        FUSED(3);
+        DISPATCH();
+        _PUSH_LEA_LOAD:
+        vmm_pushstack(sp, ax._i);
+        ax._i = vmm_get((uint32_t) (bp + ins[2].arg1));
+        pc += INC_PTR * 5;
+        FUSED(3);
+        DISPATCH();
+        _PUSH_IMM_ADD:
+        // 入栈后立即出栈相加，结果等价于AX加立即数（均为32位加法）
+        ax._ui += (uint) ins[2].arg1;
+        pc += INC_PTR * 5;
+        FUSED(3);
+        DISPATCH();
+        // 按类型特化的运算：类型已在载入时确定，无需再分支
+        OP_SPEC(ADD_I32, int, _i, +)
+        OP_SPEC(ADD_I64, int64, _q, +)
+        OP_SPEC(ADD_F32, float, _f, +)
+        OP_SPEC(ADD_F64, double, _d, +)
+        OP_SPEC(SUB_I32, int, _i, -)
+        OP_SPEC(SUB_I64, int64, _q, -)
+        OP_SPEC(SUB_F32, float, _f, -)
+        OP_SPEC(SUB_F64, double, _d, -)
+        OP_SPEC(MUL_I32, int, _i, *)
+        OP_SPEC(MUL_I64, int64, _q, *)
+        OP_SPEC(MUL_F32, float, _f, *)
+        OP_SPEC(MUL_F64, double, _d, *)
+        OP_SPEC_DIV(DIV_I32, int, _i)
+        OP_SPEC_DIV(DIV_I64, int64, _q)
+        OP_SPEC_DIV(DIV_F32, float, _f)
+        OP_SPEC_DIV(DIV_F64, double, _d)
+        OP_SPEC(MOD_I32, int, _i, %)
+        OP_SPEC(OR_I32, int, _i, |)
+        OP_SPEC(XOR_I32, int, _i, ^)
+        OP_SPEC(AND_I32, int, _i, &)
+        OP_SPEC(SHL_I32, int, _i, <<)
+        OP_SPEC(SHR_I32, int, _i, >>)
+        OP_SPEC_CMP(EQ_I32, int, _i, ==)
+        OP_SPEC_CMP(EQ_F64, double, _d, ==)
+        OP_SPEC_CMP(NE_I32, int, _i, !=)
+        OP_SPEC_CMP(NE_F64, double, _d, !=)
+        OP_SPEC_CMP(LT_I32, int, _i, <)
+        OP_SPEC_CMP(LT_U32, uint, _ui, <)
+        OP_SPEC_CMP(LT_F64, double, _d, <)
+        OP_SPEC_CMP(GT_I32, int, _i, >)
+        OP_SPEC_CMP(GT_U32, uint, _ui, >)
+        OP_SPEC_CMP(GT_F64, double, _d, >)
+        OP_SPEC_CMP(LE_I32, int, _i, <=)
+        OP_SPEC_CMP(LE_U32, uint, _ui, <=)
+        OP_SPEC_CMP(LE_F64, double, _d, <=)
+        OP_SPEC_CMP(GE_I32, int, _i, >=)
+        OP_SPEC_CMP(GE_U32, uint, _ui, >=)
+        OP_SPEC_CMP(GE_F64, double, _d, >=)
+        _INVALID:
+#if LOG_SYSTEM
+        printf("[SYSTEM] ERR  | AX: %08X BP: %08X SP: %08X PC: %08X\n", ax._i, bp, sp, pc);
+        printf("[SYSTEM] ERR  | unknown instruction: %d\n", ins->op);
+#endif
+        STORE_REGS();
+        error("unknown instruction");
+        return false;
+        _OUTSIDE:
+        STORE_REGS();
+        if (user)
+            return true;
+        exec(1, cycles); // 代码段之外（如栈上的退出桩），交给switch解释执行
+        return false;
+        _END:
+        STORE_REGS();
+        return false;
+        _NATIVE:
+        if (global_state.exec_mode != EXEC_JIT)
+            goto *labels[ins->op];
+        // 撤销本次分派，由本地代码自行计数
+        pc -= INC_PTR;
+        cycles--;
+        STORE_REGS();
+        {
+            auto remain = image.jit->enter(ctx, idx, budget + 1);
+            cycles += budget + 1 - std::max(remain, 0);
+            budget = remain;
+        }
+        LOAD_REGS();
+        if (jit_fault) {
+            auto e = *jit_fault;
+            jit_fault.reset();
+            throw e;
+        }
+        DISPATCH();
+
+#undef OP_END
+#undef OP_CMP
+#undef OP_PTR
+#undef OP_FLT
+#undef OP_INT
+#undef OP_SPEC_DIV
+#undef OP_SPEC_CMP
+#undef OP_SPEC
+#undef FUSED
+#undef DISPATCH
+#undef DEFER
+#undef LOAD_REGS
+#undef STORE_REGS
+#else
+        if (table) {
+            *table = nullptr;
+            return false;
+        }
+        exec(cycle, cycles);
+#endif
+    }
+
+    // 编译热点函数，成功后把已编译代码字的处理例程改为进入本地代码
+    bool cvm::jit_compile(uint32_t entry) {
+        const void *const *table = nullptr;
+        int dummy = 0;
+        exec_threaded(0, dummy, &table);
+        if (!table || !cjit::available())
+            return false;
+        auto &image = *ctx->code;
+        if (!image.jit)
+            image.jit = std::make_unique<cjit>();
+        jit_env_t env;
+        env.vm = this;
+        env.off_ax = (int) ((byte *) &ctx->ax - (byte *) ctx);
+        env.off_sp = (int) ((byte *) &ctx->sp - (byte *) ctx);
+        env.off_bp = (int) ((byte *) &ctx->bp - (byte *) ctx);
+        env.off_pc = (int) ((byte *) &ctx->pc - (byte *) ctx);
+        env.off_base = (int) ((byte *) &ctx->base - (byte *) ctx);
+        env.resolve = &jit_resolve;
+        std::vector<int> text(image.ins.size());
+        for (size_t i = 0; i < text.size(); ++i)
+            text[i] = image.ins[i].op;
+        auto compiled = image.jit->compile(env, text, entry);
+        for (auto &i : compiled)
+            image.ins[i].handler = table[INS_END + 1];
 #if LOG_SYSTEM
-                    printf("[SYSTEM] ERR  | AX: %08X BP: %08X SP: %08X PC: %08X\n", ctx->ax._i, ctx->bp, ctx->sp, ctx->pc);
-                    for (uint32_t j = ctx->sp; j < STACK_BASE + PAGE_SIZE; j += 4) {
-                        printf("[SYSTEM] ERR  | [%08X]> %08X\n", j, vmm_get<uint32_t>(j));
-                    }
-                    printf("[SYSTEM] ERR  | unknown instruction: %d\n", op);
+        printf("[SYSTEM] JIT  | PID= #%d, ENTRY= %08X, INS= %d, TOTAL= %d bytes\n",
+               ctx->id, ctx->base + entry * INC_PTR, (int) compiled.size(), (int) image.jit->code_size());
 #endif
-                    error("unknown instruction");
-                }
-            }
+        return !compiled.empty();
+    }
 
-#if LOG_STACK
-            if (ctx->debug) {
-                printf("\n---------------- STACK BEGIN <<<< \n");
-                printf("AX: %08X BX: %08X BP: %08X SP: %08X PC: %08X\n", ctx->ax._u._1, ctx->ax._u._2, ctx->bp, ctx->sp, ctx->pc);
-                auto k = 0;
-                for (uint32_t j = ctx->sp; j < STACK_BASE + PAGE_SIZE; j += 4, ++k) {
-                    printf("[%08X]> %08X", j, vmm_get<uint32_t>(j));
-                    if (k % 4 == 3)
-                        printf("\n");
-                    else
-                        printf("  |  ");
-                }
-                if (k % 4 != 0)
-                    printf("\n");
-                printf("---------------- STACK END >>>>\n\n");
+#if CVM_JIT
+    // 常用且很少改动的程序，载入时即编译全部函数，映像常驻缓存
+    static const char *aot_images[] = {
+        "/bin/sh",
+        "/bin/cat",
+        "/bin/grep",
+        "/bin/ls",
+    };
+#endif
+
+    void cvm::aot_compile() {
+#if CVM_JIT
+        auto &image = *ctx->code;
+        if (image.aot || global_state.exec_mode != EXEC_JIT || !cjit::available())
+            return;
+        if (std::find(std::begin(aot_images), std::end(aot_images), ctx->path) == std::end(aot_images))
+            return;
+        image.aot = true;
+        image_pinned.push_back(ctx->code);
+        for (uint32_t i = 0; i < image.ins.size(); ++i) {
+            if (image.boundary[i] && image.ins[i].op == ENT && image.calls[i] < JIT_THRESHOLD) {
+                image.calls[i] = JIT_THRESHOLD;
+                if (!(image.jit && image.jit->has(i)))
+                    jit_compile(i);
             }
+        }
 #endif
+    }
+
+    int cvm::jit_fail(cvm *vm, const cexception &e) {
+        vm->jit_fault = std::make_unique<cexception>(e);
+        return 1;
+    }
+
+    int cvm::jit_load(void *p, int n) {
+        auto vm = (cvm *) p;
+        try {
+            if (n == 4)
+                vm->ctx->ax._i = vm->vmm_get((uint32_t) vm->ctx->ax._i);
+            else
+                vm->load_ax(n);
+        } catch (const cexception &e) {
+            return jit_fail(vm, e);
+        }
+        return 0;
+    }
+
+    int cvm::jit_save(void *p, int n) {
+        auto vm = (cvm *) p;
+        try {
+            if (n == 4)
+                vm->vmm_set((uint32_t) vm->vmm_popstack(vm->ctx->sp), vm->ctx->ax._i);
+            else
+                vm->save_ax(n);
+        } catch (const cexception &e) {
+            return jit_fail(vm, e);
+        }
+        return 0;
+    }
+
+    int cvm::jit_push(void *p, int n) {
+        auto vm = (cvm *) p;
+        try {
+            if (n == 4)
+                vm->vmm_pushstack(vm->ctx->sp, vm->ctx->ax._i);
+            else
+                vm->push_ax(n);
+        } catch (const cexception &e) {
+            return jit_fail(vm, e);
+        }
+        return 0;
+    }
+
+    int cvm::jit_pop(void *p, int n) {
+        auto vm = (cvm *) p;
+        try {
+            if (n == 4)
+                vm->ctx->ax._i = vm->vmm_popstack(vm->ctx->sp);
+            else
+                vm->pop_ax(n);
+        } catch (const cexception &e) {
+            return jit_fail(vm, e);
+        }
+        return 0;
+    }
+
+    int cvm::jit_ent(void *p, int n) {
+        auto vm = (cvm *) p;
+        auto ctx = vm->ctx;
+        try {
+            vm->vmm_pushstack(ctx->sp, ctx->bp);
+            ctx->bp = ctx->sp;
+            ctx->sp = ctx->sp - n;
+        } catch (const cexception &e) {
+            return jit_fail(vm, e);
+        }
+        return 0;
+    }
+
+    int cvm::jit_call(void *p, int ret) {
+        auto vm = (cvm *) p;
+        auto ctx = vm->ctx;
+        try {
+            vm->vmm_pushstack(ctx->sp, ctx->base + (uint32_t) ret);
+            ctx->pc = ctx->base + (ctx->ax._ui) * INC_PTR;
+            vm->check_pc(ctx->pc);
+        } catch (const cexception &e) {
+            return jit_fail(vm, e);
+        }
+        return 0;
+    }
+
+    int cvm::jit_lev(void *p, int) {
+        auto vm = (cvm *) p;
+        auto ctx = vm->ctx;
+        try {
+            ctx->sp = ctx->bp;
+            ctx->bp = (uint32_t) vm->vmm_popstack(ctx->sp);
+            ctx->pc = (uint32_t) vm->vmm_popstack(ctx->sp);
+            vm->check_pc(ctx->pc);
+        } catch (const cexception &e) {
+            return jit_fail(vm, e);
+        }
+        return 0;
+    }
+
+    int cvm::jit_case(void *p, int) {
+        auto vm = (cvm *) p;
+        auto ctx = vm->ctx;
+        try {
+            if (vm->vmm_get(ctx->sp) == ctx->ax._i) {
+                ctx->sp += INC_PTR;
+                ctx->ax._i = 0; // 0 for same
+            } else {
+                ctx->ax._i = 1;
+            }
+        } catch (const cexception &e) {
+            return jit_fail(vm, e);
+        }
+        return 0;
+    }
+
+    // 运算：左操作数出栈，右操作数为AX，结果写回AX
+    template<class T, class R, class F>
+    int cvm::jit_binop(void *p, int) {
+        auto vm = (cvm *) p;
+        auto &ax = vm->ctx->ax;
+        try {
+            auto a = vm->vmm_popstack<T>(vm->ctx->sp);
+            *(R *) &ax = (R) F()(a, *(T *) &ax);
+        } catch (const cexception &e) {
+            return jit_fail(vm, e);
+        }
+        return 0;
+    }
+
+    template<class T, class R, class F>
+    int cvm::jit_unop(void *p, int) {
+        auto &ax = ((cvm *) p)->ctx->ax;
+        *(R *) &ax = (R) F()(*(T *) &ax);
+        return 0;
+    }
+
+#define JIT_OP(name, o) \
+    struct name { template<class T> auto operator()(T a, T b) const -> decltype(a o b) { return a o b; } };
+    JIT_OP(jit_or, |)
+    JIT_OP(jit_xor, ^)
+    JIT_OP(jit_and, &)
+    JIT_OP(jit_eq, ==)
+    JIT_OP(jit_ne, !=)
+    JIT_OP(jit_lt, <)
+    JIT_OP(jit_le, <=)
+    JIT_OP(jit_gt, >)
+    JIT_OP(jit_ge, >=)
+    JIT_OP(jit_shl, <<)
+    JIT_OP(jit_shr, >>)
+    JIT_OP(jit_add, +)
+    JIT_OP(jit_sub, -)
+    JIT_OP(jit_mul, *)
+    JIT_OP(jit_mod, %)
+#undef JIT_OP
+
+    struct jit_div {
+        template<class T>
+        T operator()(T a, T b) const {
+            if (b == 0)
+                throw cexception(ex_vm, "divide zero exception");
+            return a / b;
+        }
+    };
+
+    struct jit_neg { template<class T> T operator()(T a) const { return -a; } };
+    struct jit_not { template<class T> T operator()(T a) const { return ~a; } };
+    struct jit_lnt { template<class T> int operator()(T a) const { return a ? 0 : 1; } };
+    // 与解释器保持一致（浮点取反结果与整数相反）
+    struct jit_lnt_f { template<class T> int operator()(T a) const { return a == 0 ? 0 : 1; } };
+
+    // 按操作码和类型选取辅助函数，不支持的交给解释器
+    jit_helper_t cvm::jit_resolve(int op, int arg) {
+#define JIT_INT(f) \
+            case t_char: \
+            case t_short: \
+            case t_int: \
+                return &jit_binop<int, int, f>; \
+            case t_uchar: \
+            case t_ushort: \
+            case t_uint: \
+                return &jit_binop<uint, uint, f>; \
+            case t_long: \
+                return &jit_binop<int64, int64, f>; \
+            case t_ulong: \
+                return &jit_binop<uint64, uint64, f>;
+
+#define JIT_FLT(f) \
+            case t_float: \
+                return &jit_binop<float, float, f>; \
+            case t_double: \
+                return &jit_binop<double, double, f>;
+
+#define JIT_PTR(f) \
+            case t_ptr: \
+                return &jit_binop<uint, uint, f>;
+
+#define JIT_CMP(f) \
+            case t_char: \
+            case t_short: \
+            case t_int: \
+                return &jit_binop<int, int, f>; \
+            case t_uchar: \
+            case t_ushort: \
+            case t_uint: \
+            case t_ptr: \
+                return &jit_binop<uint, int, f>; \
+            case t_long: \
+                return &jit_binop<int64, int, f>; \
+            case t_ulong: \
+                return &jit_binop<uint64, int, f>; \
+            case t_float: \
+                return &jit_binop<float, int, f>; \
+            case t_double: \
+                return &jit_binop<double, int, f>;
+
+#define JIT_END \
+            default: \
+                return nullptr;
+
+        switch (op) {
+            case LOAD:
+                return &jit_load;
+            case SAVE:
+                return &jit_save;
+            case PUSH:
+                return &jit_push;
+            case POP:
+                return &jit_pop;
+            case ENT:
+                return &jit_ent;
+            case CALL:
+                return &jit_call;
+            case LEV:
+                return &jit_lev;
+            case CASE:
+                return &jit_case;
+            case OR:
+                switch ((cast_t) arg) { JIT_INT(jit_or) JIT_END }
+            case XOR:
+                switch ((cast_t) arg) { JIT_INT(jit_xor) JIT_END }
+            case AND:
+                switch ((cast_t) arg) { JIT_INT(jit_and) JIT_END }
+            case SHL:
+                switch ((cast_t) arg) { JIT_INT(jit_shl) JIT_END }
+            case SHR:
+                switch ((cast_t) arg) { JIT_INT(jit_shr) JIT_END }
+            case MOD:
+                switch ((cast_t) arg) { JIT_INT(jit_mod) JIT_END }
+            case ADD:
+                switch ((cast_t) arg) { JIT_INT(jit_add) JIT_FLT(jit_add) JIT_PTR(jit_add) JIT_END }
+            case SUB:
+                switch ((cast_t) arg) { JIT_INT(jit_sub) JIT_FLT(jit_sub) JIT_PTR(jit_sub) JIT_END }
+            case MUL:
+                switch ((cast_t) arg) { JIT_INT(jit_mul) JIT_FLT(jit_mul) JIT_END }
+            case DIV:
+                switch ((cast_t) arg) { JIT_INT(jit_div) JIT_FLT(jit_div) JIT_END }
+            case EQ:
+                switch ((cast_t) arg) { JIT_CMP(jit_eq) JIT_END }
+            case NE:
+                switch ((cast_t) arg) { JIT_CMP(jit_ne) JIT_END }
+            case LT:
+                switch ((cast_t) arg) { JIT_CMP(jit_lt) JIT_END }
+            case LE:
+                switch ((cast_t) arg) { JIT_CMP(jit_le) JIT_END }
+            case GT:
+                switch ((cast_t) arg) { JIT_CMP(jit_gt) JIT_END }
+            case GE:
+                switch ((cast_t) arg) { JIT_CMP(jit_ge) JIT_END }
+            case NEG:
+                switch ((cast_t) arg) {
+                    case t_char:
+                    case t_short:
+                    case t_int:
+                        return &jit_unop<int, int, jit_neg>;
+                    case t_long:
+                        return &jit_unop<int64, int64, jit_neg>;
+                    case t_float:
+                        return &jit_unop<float, float, jit_neg>;
+                    case t_double:
+                        return &jit_unop<double, double, jit_neg>;
+                    JIT_END
+                }
+            case NOT:
+                switch ((cast_t) arg) {
+                    case t_char:
+                    case t_short:
+                    case t_int:
+                        return &jit_unop<int, int, jit_not>;
+                    case t_uchar:
+                    case t_ushort:
+                    case t_uint:
+                        return &jit_unop<uint, uint, jit_not>;
+                    case t_long:
+                        return &jit_unop<int64, int64, jit_not>;
+                    case t_ulong:
+                        return &jit_unop<uint64, uint64, jit_not>;
+                    JIT_END
+                }
+            case LNT:
+                switch ((cast_t) arg) {
+                    case t_char:
+                    case t_short:
+                    case t_int:
+                        return &jit_unop<int, int, jit_lnt>;
+                    case t_uchar:
+                    case t_ushort:
+                    case t_uint:
+                    case t_ptr:
+                        return &jit_unop<uint, int, jit_lnt>;
+                    case t_long:
+                        return &jit_unop<int64, int, jit_lnt>;
+                    case t_ulong:
+                        return &jit_unop<uint64, int, jit_lnt>;
+                    case t_float:
+                        return &jit_unop<float, int, jit_lnt_f>;
+                    case t_double:
+                        return &jit_unop<double, int, jit_lnt_f>;
+                    JIT_END
+                }
+            default:
+                return nullptr;
         }
+
+#undef JIT_END
+#undef JIT_CMP
+#undef JIT_PTR
+#undef JIT_FLT
+#undef JIT_INT
     }
 
     void cvm::error(const string_t &str) const {
@@ -1123,44 +3066,63 @@ namespace clib {
 
     int cvm::load(const string_t &path, const std::vector<byte> &file, const std::vector<string_t> &args) {
         auto old_ctx = ctx;
+        std::vector<uint32_t> text;
+        auto boundary = verify(file, text);
         new_pid();
         ctx->file = file;
 #if LOG_SYSTEM
         printf("[SYSTEM] PROC | Create: PID= #%d\n", ctx->id);
 #endif
         PE *pe = (PE *) file.data();
-        // TODO: VALID PE FILE
         uint32_t pa;
-        ctx->poolsize = PAGE_SIZE;
-        ctx->mask = U2K(ctx->id);
+        ctx->poolsize = STACK_LIMIT;
+        ctx->pgdir = pmm_alloc(); // 每个进程独立的地址空间
         ctx->entry = pe->entry;
-        ctx->stack = STACK_BASE | ctx->mask;
-        ctx->data = DATA_BASE | ctx->mask;
-        ctx->base = USER_BASE | ctx->mask;
-        ctx->heap = HEAP_BASE | ctx->mask;
+        ctx->stack = STACK_BASE;
+        ctx->data = DATA_BASE;
+        ctx->base = USER_BASE;
+        ctx->heap = HEAP_BASE;
         ctx->pool = std::make_unique<cmem>(this);
+        ctx->mmap_top = MMAP_BASE;
+        ctx->mmaps.clear();
         ctx->flag |= CTX_KERNEL;
-        ctx->state = CTS_RUNNING;
+        ctx->priority = PRIORITY_DEFAULT;
+        set_state(*ctx, CTS_RUNNING);
         ctx->path = path;
+        ctx->tlb_hit = 0;
+        ctx->tlb_miss = 0;
+        tlb_flush();
         /* 映射4KB的代码空间 */
         {
             auto size = PAGE_SIZE / sizeof(int);
-            auto text_size = pe->text_len / sizeof(int);
-            auto text_start = (uint32_t *) (&pe->data + pe->data_len);
-            for (uint32_t i = 0, start = 0; start < text_size; ++i, start += size) {
-                auto new_page = (uint32_t) pmm_alloc();
-                ctx->text_mem.push_back(new_page);
-                vmm_map(ctx->base + PAGE_SIZE * i, new_page, PTE_U | PTE_P); // 用户代码空间
-                if (vmm_ismap(ctx->base + PAGE_SIZE * i, &pa)) {
+            auto text_size = (uint32_t) text.size();
+            auto text_start = text.data();
+            decode(text_start, text_size, std::move(boundary));
+            // 同一映像的代码页只生成一次，映像持有一份引用，各进程只读映射
+            auto &pages = ctx->code->pages;
+            if (pages.empty()) {
+                for (uint32_t start = 0; start < text_size; start += size) {
+                    auto new_page = pmm_alloc(); // 本进程的引用
+                    frame_refs[PAGE_FRAME(new_page)]++; // 映像的引用
+                    pages.push_back(new_page);
                     auto s = start + size > text_size ? (text_size & (size - 1)) : size;
                     for (uint32_t j = 0; j < s; ++j) {
-                        *((uint32_t *) pa + j) = (uint) text_start[start + j];
-#if 0
-                        printf("[%p]> [%08X] %08X\n", (void*)((int*)pa + j), ctx->base + PAGE_SIZE * i + j * 4, vmm_get<uint32_t>(ctx->base + PAGE_SIZE * i + j * 4));
-#endif
+                        *((uint32_t *) pmm_addr(new_page) + j) = (uint) text_start[start + j];
                     }
                 }
+            } else {
+                for (auto &page : pages) {
+                    frame_refs[PAGE_FRAME(page)]++;
+                }
+            }
+            for (uint32_t i = 0; i < pages.size(); ++i) {
+                vmm_map(ctx->base + PAGE_SIZE * i, pages[i], PTE_U | PTE_P); // 用户代码空间
+                if (!vmm_ismap(ctx->base + PAGE_SIZE * i, &pa)) {
+                    destroy(ctx->id);
+                    error("load: text segment map failed");
+                }
             }
+            aot_compile();
         }
         /* 映射4KB的数据空间 */
         {
@@ -1168,13 +3130,12 @@ namespace clib {
             auto data_size = pe->data_len;
             auto data_start = (char *) &pe->data;
             for (uint32_t i = 0, start = 0; start < data_size; ++i, start += size) {
-                auto new_page = (uint32_t) pmm_alloc();
-                ctx->data_mem.push_back(new_page);
+                auto new_page = pmm_alloc();
                 vmm_map(ctx->data + PAGE_SIZE * i, new_page, PTE_U | PTE_P | PTE_R); // 用户数据空间
                 if (vmm_ismap(ctx->data + PAGE_SIZE * i, &pa)) {
                     auto s = start + size > data_size ? ((sint) data_size & (size - 1)) : size;
                     for (auto j = 0; j < s; ++j) {
-                        *((char *) pa + j) = data_start[start + j];
+                        *((char *) pmm_addr(pa) + j) = data_start[start + j];
 #if 0
                         printf("[%p]> [%08X] %d\n", (void*)((char*)pa + j), ctx->data + PAGE_SIZE * i + j, vmm_get<byte>(ctx->data + PAGE_SIZE * i + j));
 #endif
@@ -1182,19 +3143,15 @@ namespace clib {
                 }
             }
         }
-        /* 映射4KB的栈空间 */
+        /* 映射栈顶4KB，其余按需映射 */
         {
-            auto new_page = (uint32_t) pmm_alloc();
+            auto new_page = pmm_alloc();
             ctx->stack_mem.push_back(new_page);
-            vmm_map(ctx->stack, new_page, PTE_U | PTE_P | PTE_R); // 用户栈空间
+            vmm_map(ctx->stack + ctx->poolsize - PAGE_SIZE, new_page, PTE_U | PTE_P | PTE_R); // 用户栈空间
         }
         ctx->flag &= ~CTX_KERNEL;
         {
-            ctx->stack = STACK_BASE;
-            ctx->data = DATA_BASE;
-            ctx->base = USER_BASE;
-            ctx->heap = HEAP_BASE;
-            ctx->sp = ctx->stack + ctx->poolsize; // 4KB / sizeof(int) = 1024
+            ctx->sp = ctx->stack + ctx->poolsize; // 栈顶STACK_TOP
             ctx->pc = ctx->base | (ctx->entry * INC_PTR);
             ctx->ax._i = 0;
             ctx->bp = 0;
@@ -1218,9 +3175,11 @@ namespace clib {
         ctx->flag |= CTX_USER_MODE | CTX_FOREGROUND;
         ctx->debug = false;
         ctx->waiting_ms = 0;
+        ctx->sleeping = false;
+        ctx->waiting_child = false;
         ctx->input_redirect = -1;
         ctx->output_redirect = -1;
-        ctx->input_queue.clear();
+        ctx->input_pipe.reset();
         ctx->input_stop = false;
         available_tasks++;
         auto pid = ctx->id;
@@ -1232,11 +3191,12 @@ namespace clib {
         auto old_ctx = ctx;
         ctx = &tasks[id];
         {
+            for (auto q : {&global_state.input_lock_list, &global_state.input_waiting_list,
+                           &global_state.input_read_list}) {
+                q->erase(std::remove(q->begin(), q->end(), ctx->id), q->end());
+            }
             if (global_state.input_lock == ctx->id) {
-                global_state.input_lock = -1;
-                global_state.input_read_ptr = -1;
-                global_state.input_content.clear();
-                global_state.input_success = false;
+                input_release();
                 cgui::singleton().reset_cmd();
             }
             if (set_cycle_id == ctx->id) {
@@ -1247,18 +3207,30 @@ namespace clib {
                 cgui::singleton().resize(0, 0);
                 set_resize_id = -1;
             }
+            // 读端退出：之后的写入直接丢弃，唤醒等待空间的写者
+            ctx->input_pipe.closed = true;
+            wake_all(ctx->input_pipe.writers);
             if (ctx->output_redirect != -1 && tasks[ctx->output_redirect].flag & CTX_VALID) {
-                if (!ctx->input_queue.empty()) {
-                    std::copy(ctx->input_queue.begin(), ctx->input_queue.end(),
-                              std::back_inserter(tasks[ctx->output_redirect].input_queue));
+                auto &next = tasks[ctx->output_redirect];
+                auto &writers = next.input_pipe.writers;
+                writers.erase(std::remove(writers.begin(), writers.end(), ctx->id), writers.end());
+                if (ctx->input_pipe.size > 0) {
+                    // 未读完的输入转交下游，超出其剩余空间的部分丢弃
+                    byte buf[PAGE_SIZE];
+                    uint32_t n;
+                    while ((n = ctx->input_pipe.read(buf, std::min((uint32_t) PAGE_SIZE,
+                                                                   next.input_pipe.space()))) > 0) {
+                        next.input_pipe.write(buf, n);
+                    }
                     ctx->input_redirect = -1;
                 }
-                tasks[ctx->output_redirect].input_stop = true;
+                next.input_stop = true;
+                wake_all(next.input_pipe.readers);
                 ctx->output_redirect = -1;
             }
         }
         if (!ctx->child.empty()) {
-            ctx->state = CTS_ZOMBIE;
+            set_state(*ctx, CTS_ZOMBIE);
             ctx = old_ctx;
             return;
         }
@@ -1267,48 +3239,20 @@ namespace clib {
 #endif
         ctx->flag = 0;
         {
-            PE *pe = (PE *) ctx->file.data();
-            ctx->poolsize = PAGE_SIZE;
-            ctx->mask = U2K(ctx->id);
-            ctx->entry = pe->entry;
-            ctx->stack = STACK_BASE | ctx->mask;
-            ctx->data = DATA_BASE | ctx->mask;
-            ctx->base = USER_BASE | ctx->mask;
-            ctx->heap = HEAP_BASE | ctx->mask;
-            ctx->flag |= CTX_KERNEL;
-            /* 映射4KB的代码空间 */
-            {
-                auto size = PAGE_SIZE / sizeof(int);
-                auto text_size = pe->text_len / sizeof(int);
-                for (uint32_t i = 0, start = 0; start < text_size; ++i, start += size) {
-                    vmm_unmap(ctx->base + PAGE_SIZE * i); // 用户代码空间
-                }
-            }
-            /* 映射4KB的数据空间 */
-            {
-                auto size = PAGE_SIZE;
-                auto data_size = pe->data_len;
-                for (uint32_t i = 0, start = 0; start < data_size; ++i, start += size) {
-                    vmm_unmap(ctx->data + PAGE_SIZE * i); // 用户数据空间
-                }
-            }
-            /* 映射4KB的栈空间 */
-            vmm_unmap(ctx->stack); // 用户栈空间
-            /* 映射16KB的堆空间 */
-            {
-                for (int i = 0; i < ctx->pool->page_size(); ++i) {
-                    vmm_unmap(ctx->heap + PAGE_SIZE * i);
-                }
-            }
-            {
-                for (auto &a : ctx->allocation) {
-                    memory.free_array((byte *) a);
-                }
-            }
+            /* 释放整个地址空间 */
+            vmm_release();
             ctx->child.clear();
-            ctx->state = CTS_DEAD;
+            set_state(*ctx, CTS_DEAD);
             ctx->file.clear();
-            ctx->allocation.clear();
+            // 最后一个使用该映像的进程退出（且映像未常驻），释放映像持有的代码页
+            if (ctx->code && ctx->code.use_count() == 1) {
+                for (auto &page : ctx->code->pages) {
+                    pmm_free(page);
+                }
+                ctx->code->pages.clear();
+            }
+            ctx->code.reset();
+            tlb_flush();
             ctx->pool.reset();
             ctx->flag = 0;
             auto handles = ctx->handles;
@@ -1321,14 +3265,16 @@ namespace clib {
                 parent.child.erase(ctx->id);
                 if (parent.state == CTS_ZOMBIE)
                     destroy(ctx->parent);
-                else if (parent.state == CTS_WAIT)
-                    parent.state = CTS_RUNNING;
+                else if (parent.waiting_child) { // 只唤醒阻塞在wait中的父进程
+                    parent.waiting_child = false;
+                    set_state(parent, CTS_RUNNING);
+                }
                 ctx->parent = -1;
             }
-            ctx->data_mem.clear();
-            ctx->text_mem.clear();
             ctx->stack_mem.clear();
-            ctx->input_queue.clear();
+            ctx->mmaps.clear();
+            ctx->input_pipe.reset();
+            ctx->input_pipe.closed = true;
             {
                 std::stringstream ss;
                 ss << "/proc/" << ctx->id;
@@ -1385,70 +3331,24 @@ namespace clib {
 #if LOG_SYSTEM
         printf("[SYSTEM] PROC | Fork: Parent= #%d, Child= #%d\n", old_ctx->id, ctx->id);
 #endif
-        PE *pe = (PE *) ctx->file.data();
         // TODO: VALID PE FILE
-        uint32_t pa;
-        ctx->poolsize = PAGE_SIZE;
-        ctx->mask = ((uint) (ctx->id << 16) & 0x00ff0000);
+        ctx->poolsize = old_ctx->poolsize;
+        ctx->pgdir = pmm_alloc();
         ctx->entry = old_ctx->entry;
-        ctx->stack = old_ctx->stack | ctx->mask;
-        ctx->data = old_ctx->data | ctx->mask;
-        ctx->base = old_ctx->base | ctx->mask;
-        ctx->heap = old_ctx->heap | ctx->mask;
         ctx->pool = std::make_unique<cmem>(this);
         ctx->flag |= CTX_KERNEL;
-        ctx->state = CTS_RUNNING;
+        ctx->priority = old_ctx->priority;
+        set_state(*ctx, CTS_RUNNING);
         ctx->path = old_ctx->path;
         old_ctx->child.insert(ctx->id);
         ctx->parent = old_ctx->id;
-        /* 映射4KB的代码空间 */
-        {
-            auto size = PAGE_SIZE / sizeof(int);
-            auto text_size = pe->text_len / sizeof(int);
-            for (uint32_t i = 0, start = 0; start < text_size; ++i, start += size) {
-                auto new_page = (uint32_t) pmm_alloc();
-                std::copy((byte *) (old_ctx->text_mem[i]),
-                          (byte *) (old_ctx->text_mem[i]) + PAGE_SIZE,
-                          (byte *) new_page);
-                ctx->text_mem.push_back(new_page);
-                vmm_map(ctx->base + PAGE_SIZE * i, new_page, PTE_U | PTE_P | PTE_R); // 用户代码空间
-                if (!vmm_ismap(ctx->base + PAGE_SIZE * i, &pa)) {
-                    destroy(ctx->id);
-                    error("fork: text segment copy failed");
-                }
-            }
-        }
-        /* 映射4KB的数据空间 */
-        {
-            auto size = PAGE_SIZE;
-            auto data_size = pe->data_len;
-            for (uint32_t i = 0, start = 0; start < data_size; ++i, start += size) {
-                auto new_page = (uint32_t) pmm_alloc();
-                ctx->data_mem.push_back(new_page);
-                std::copy((byte *) (old_ctx->data_mem[i]),
-                          (byte *) (old_ctx->data_mem[i]) + PAGE_SIZE,
-                          (byte *) new_page);
-                vmm_map(ctx->data + PAGE_SIZE * i, new_page, PTE_U | PTE_P | PTE_R); // 用户数据空间
-                if (!vmm_ismap(ctx->data + PAGE_SIZE * i, &pa)) {
-                    destroy(ctx->id);
-                    error("fork: data segment copy failed");
-                }
-            }
-        }
-        /* 映射4KB的栈空间 */
-        {
-            auto new_page = (uint32_t) pmm_alloc();
-            ctx->stack_mem.push_back(new_page);
-            std::copy((byte *) (old_ctx->stack_mem[0]),
-                      (byte *) (old_ctx->stack_mem[0]) + PAGE_SIZE,
-                      (byte *) new_page);
-            vmm_map(ctx->stack, new_page, PTE_U | PTE_P | PTE_R); // 用户栈空间
-            if (!vmm_ismap(ctx->stack, &pa)) {
-                destroy(ctx->id);
-                error("fork: stack segment copy failed");
-            }
-        }
-        /* 映射堆空间 */
+        ctx->tlb_hit = 0;
+        ctx->tlb_miss = 0;
+        tlb_flush();
+        // 写时复制：页框不复制，父子进程共享，代码页只读，其余页首次写入时再复制
+        vmm_share(old_ctx->pgdir);
+        ctx->stack_mem = old_ctx->stack_mem;
+        ctx->code = old_ctx->code;
         ctx->pool->copy_from(*old_ctx->pool);
         ctx->flag = old_ctx->flag;
         ctx->sp = old_ctx->sp;
@@ -1456,32 +3356,34 @@ namespace clib {
         ctx->data = old_ctx->data;
         ctx->base = old_ctx->base;
         ctx->heap = old_ctx->heap;
+        ctx->mmap_top = old_ctx->mmap_top;
+        ctx->mmaps = old_ctx->mmaps;
         ctx->pc = old_ctx->pc;
         ctx->ax._i = -1;
         ctx->bp = old_ctx->bp;
         ctx->debug = old_ctx->debug;
         ctx->waiting_ms = 0;
+        ctx->sleeping = false;
+        ctx->waiting_child = false;
         ctx->input_redirect = old_ctx->input_redirect;
         ctx->output_redirect = old_ctx->output_redirect;
         ctx->input_stop = old_ctx->input_stop;
+        ctx->input_pipe.reset();
         ctx->handles = old_ctx->handles;
         available_tasks++;
         auto pid = ctx->id;
         ctx = old_ctx;
+        tlb_flush();
         return pid;
     }
 
-    void cvm::map_page(uint32_t addr, uint32_t id) {
-        uint32_t pa;
-        auto va = (ctx->heap | ctx->mask) | (PAGE_SIZE * id);
-        vmm_map(va, addr, PTE_U | PTE_P | PTE_R);
-#if LOG_SYSTEM
-        printf("[SYSTEM] MEM  | Map: PA= %p, VA= %p\n", (void *) addr, (void *) va);
-#endif
-        if (!vmm_ismap(va, &pa)) {
-            destroy(ctx->id);
-            error("heap alloc: alloc page failed");
-        }
+    void cvm::unmap_page(uint32_t id) {
+        auto va = ctx->heap + PAGE_SIZE * id;
+        auto pte = vmm_pte(va);
+        if (!pte)
+            return;
+        pmm_free(*pte & PAGE_MASK);
+        vmm_unmap(va);
     }
 
     void cvm::as_root(bool flag) {
@@ -1542,7 +3444,28 @@ namespace clib {
                     sprintf(sz, "%d", tasks[id].parent);
                     return sz;
                 } else if (op == "heap_size") {
-                    sprintf(sz, "%d", tasks[id].pool->page_size());
+                    sprintf(sz, "resident: %u KB, virtual: %u KB",
+                            vmm_resident(tasks[id].pgdir, HEAP_BASE, 0xffffffff) * (PAGE_SIZE / 1024),
+                            (uint32_t) tasks[id].pool->page_size() * (PAGE_SIZE / 1024));
+                    return sz;
+                } else if (op == "malloc") {
+                    const auto &st = tasks[id].pool->stat();
+                    sprintf(sz, "alloc: %llu, avg: %llu ns, free: %llu, avg: %llu ns, realloc: %llu, in place: %llu",
+                            st.alloc_count, st.alloc_count ? st.alloc_ns / st.alloc_count : 0ULL,
+                            st.free_count, st.free_count ? st.free_ns / st.free_count : 0ULL,
+                            st.resize_count, st.resize_inplace);
+                    return sz;
+                } else if (op == "stack") {
+                    // 栈页只增不减，已映射的大小即高水位
+                    sprintf(sz, "peak: %u bytes, pages: %u, limit: %u bytes",
+                            (uint32_t) tasks[id].stack_mem.size() * PAGE_SIZE,
+                            (uint32_t) tasks[id].stack_mem.size(), STACK_LIMIT - STACK_GUARD);
+                    return sz;
+                } else if (op == "tlb") {
+                    auto total = tasks[id].tlb_hit + tasks[id].tlb_miss;
+                    sprintf(sz, "hit: %llu, miss: %llu, rate: %.2f%%",
+                            tasks[id].tlb_hit, tasks[id].tlb_miss,
+                            total ? 100.0 * tasks[id].tlb_hit / total : 0.0);
                     return sz;
                 }
             }
@@ -1562,11 +3485,37 @@ namespace clib {
                                     i,
                                     tasks[i].parent,
                                     limit_string(tasks[i].path, 14).c_str(),
-                                    ctx->allocation.size());
+                                    vmm_resident(tasks[i].pgdir, 0, 0xffffffff));
                             ss << sz << std::endl;
                         }
                     }
                     return ss.str();
+                } else if (op == "boot") {
+                    sprintf(sz, "vm init: %llu us", boot_us);
+                    return sz;
+                } else if (op == "ins") {
+                    std::stringstream ss;
+                    auto dispatch = ins_total - ins_fused;
+                    sprintf(sz, "instructions: %llu, dispatches: %llu, reduction: %.2f%%",
+                            ins_total, dispatch, ins_total ? 100.0 * ins_fused / ins_total : 0.0);
+                    ss << sz << std::endl;
+                    auto top = [&](const std::unordered_map<uint32_t, uint64> &m, bool triple, const char *title) {
+                        std::vector<std::pair<uint64, uint32_t>> v;
+                        for (auto &p : m)
+                            v.emplace_back(p.second, p.first);
+                        std::sort(v.begin(), v.end(), std::greater<std::pair<uint64, uint32_t>>());
+                        ss << title << std::endl;
+                        for (auto i = 0; i < 10 && i < (int) v.size(); ++i) {
+                            auto k = v[i].second;
+                            ss << "  " << v[i].first << "\t";
+                            if (triple)
+                                ss << INS_STRING((ins_t) (k >> 16)) << " ";
+                            ss << INS_STRING((ins_t) ((k >> 8) & 0xff)) << " " << INS_STRING((ins_t) (k & 0xff)) << std::endl;
+                        }
+                    };
+                    top(ins_pairs, false, "[PAIR]");
+                    top(ins_triples, true, "[TRIPLE]");
+                    return ss.str();
                 }
             }
         } else if (path.substr(0, 5) == "/http") {
@@ -1638,6 +3587,24 @@ namespace clib {
         }
     }
 
+    // 进入就绪状态时加入所在优先级的就绪队列
+    void cvm::set_state(context_t &c, ctx_state_t state) {
+        c.state = state;
+        if (state == CTS_RUNNING && !c.queued) {
+            c.queued = true;
+            ready_queue[c.priority].push_back(c.id);
+        }
+    }
+
+    // 时间片：按优先级配额，后台进程再按比例缩短，保证交互进程的响应
+    static const int slice_quota[PRIORITY_NUM] = {200, 100, 50};
+
+    int cvm::slice(const context_t &c, int cycle) const {
+        auto quota = (int64) cycle * slice_quota[c.priority] / 100;
+        quota = quota * ((c.flag & CTX_FOREGROUND) ? SLICE_FOREGROUND : SLICE_BACKGROUND) / 100;
+        return (int) std::max(std::min(quota, (int64) INT32_MAX), (int64) 2);
+    }
+
     int cvm::new_pid() {
         if (available_tasks >= TASK_NUM) {
             error("max process num!");
@@ -1657,7 +3624,7 @@ namespace clib {
                     fs.as_root(true);
                     if (fs.mkdir(dir) == 0) { // '/proc/[pid]'
                         static std::vector<string_t> ps =
-                            {"exe", "parent", "heap_size"};
+                            {"exe", "parent", "heap_size", "malloc", "stack", "tlb"};
                         dir += "/";
                         for (auto &_ps : ps) {
                             ss.str("");
@@ -1738,11 +3705,19 @@ namespace clib {
 
     int cvm::output(int id) {
         if (ctx->output_redirect != -1) {
-            if (id == 0) {
-                tasks[ctx->output_redirect].input_queue.push_back((char) ctx->ax._i);
-            } else {
-                auto s = output_fmt(id);
-                while (*s) tasks[ctx->output_redirect].input_queue.push_back(*s++);
+            auto &p = tasks[ctx->output_redirect].input_pipe;
+            if (!p.closed) {
+                auto c = (char) ctx->ax._i;
+                auto s = id == 0 ? &c : output_fmt(id);
+                auto n = id == 0 ? 1U : (uint32_t) strlen(s);
+                if (p.space() < n) {
+                    // 管道已满：挂起直到读者取走数据，再重新执行本中断
+                    wait_on(p.writers);
+                    ctx->pc -= INC_PTR;
+                    return 1;
+                }
+                p.write((const byte *) s, n);
+                wake_all(p.readers);
             }
         } else if (global_state.input_lock == -1) {
             if (id == 0) {
@@ -1754,7 +3729,7 @@ namespace clib {
         } else {
             if (global_state.input_lock != ctx->id)
                 global_state.input_waiting_list.push_back(ctx->id);
-            ctx->state = CTS_WAIT;
+            set_state(*ctx, CTS_WAIT);
             ctx->pc -= INC_PTR;
             return 1;
         }
@@ -1882,6 +3857,11 @@ namespace clib {
         return false;
     }
 
+    // 参数按声明逆序向高地址排列，i = 0 为最后一个参数
+    int cvm::intr_arg(int i) {
+        return vmm_get((uint32_t) ctx->ax._i + i * INC_PTR);
+    }
+
     bool cvm::interrupt() {
         auto id = vmm_get(ctx->pc);
         if (id > 200 && id < 300)
@@ -1917,20 +3897,23 @@ namespace clib {
                         ctx->pc += INC_PTR;
                         cgui::singleton().input_set(true);
                     } else {
-                        global_state.input_waiting_list.push_back(ctx->id);
-                        ctx->state = CTS_WAIT;
-                        ctx->pc -= INC_PTR;
+                        // 释放者会把输入锁交给队首，醒来后不必再次执行本中断
+                        wait_on(global_state.input_lock_list);
+                        ctx->pc += INC_PTR;
                     }
                 }
                 return true;
             }
             case 11: {
                 if (ctx->input_redirect != -1) {
-                    if (!ctx->input_queue.empty()) {
-                        ctx->ax._i = ctx->input_queue.front();
-                        ctx->input_queue.pop_front();
+                    if (ctx->input_pipe.size > 0) {
+                        byte c;
+                        ctx->input_pipe.read(&c, 1);
+                        wake_all(ctx->input_pipe.writers);
+                        ctx->ax._i = (char) c;
                         break;
                     } else if (!ctx->input_stop) {
+                        wait_on(ctx->input_pipe.readers);
                         ctx->pc -= INC_PTR;
                         return true;
                     } else {
@@ -1942,24 +3925,15 @@ namespace clib {
                             ctx->ax._i = -1;
                             ctx->pc += INC_PTR;
                             // INPUT COMPLETE
-                            for (auto &_id : global_state.input_waiting_list) {
-                                if (tasks[_id].flag & CTX_VALID) {
-                                    assert(tasks[_id].state == CTS_WAIT);
-                                    tasks[_id].state = CTS_RUNNING;
-                                }
-                            }
-                            global_state.input_lock = -1;
-                            global_state.input_waiting_list.clear();
-                            global_state.input_read_ptr = -1;
-                            global_state.input_content.clear();
-                            global_state.input_success = false;
-                            cgui::singleton().input_set(false);
+                            input_release();
                             return true;
                         } else {
                             ctx->ax._i = global_state.input_content[global_state.input_read_ptr++];
                             break;
                         }
                     } else {
+                        // 挂起直到键盘输入完成，再重新执行本中断
+                        wait_on(global_state.input_read_list);
                         ctx->pc -= INC_PTR;
                         return true;
                     }
@@ -1972,18 +3946,7 @@ namespace clib {
                 if (ctx->input_redirect == -1 && global_state.input_lock == ctx->id) {
                     if (global_state.input_success) {
                         // INPUT INTERRUPT
-                        for (auto &_id : global_state.input_waiting_list) {
-                            if (tasks[_id].flag & CTX_VALID) {
-                                assert(tasks[_id].state == CTS_WAIT);
-                                tasks[_id].state = CTS_RUNNING;
-                            }
-                        }
-                        global_state.input_lock = -1;
-                        global_state.input_waiting_list.clear();
-                        global_state.input_read_ptr = -1;
-                        global_state.input_content.clear();
-                        global_state.input_success = false;
-                        cgui::singleton().input_set(false);
+                        input_release();
                     }
                 } else {
                     ctx->input_stop = false;
@@ -1996,10 +3959,11 @@ namespace clib {
                 break;
             case 14: {
                 if (ctx->input_redirect != -1) {
-                    if (!ctx->input_queue.empty()) {
+                    if (ctx->input_pipe.size > 0) {
                         ctx->ax._i = 0;
                         break;
                     } else if (!ctx->input_stop) {
+                        wait_on(ctx->input_pipe.readers);
                         ctx->pc -= INC_PTR;
                         return true;
                     } else {
@@ -2011,18 +3975,7 @@ namespace clib {
                             ctx->ax._i = -1;
                             ctx->pc += INC_PTR;
                             // INPUT COMPLETE
-                            for (auto &_id : global_state.input_waiting_list) {
-                                if (tasks[_id].flag & CTX_VALID) {
-                                    assert(tasks[_id].state == CTS_WAIT);
-                                    tasks[_id].state = CTS_RUNNING;
-                                }
-                            }
-                            global_state.input_lock = -1;
-                            global_state.input_waiting_list.clear();
-                            global_state.input_read_ptr = -1;
-                            global_state.input_content.clear();
-                            global_state.input_success = false;
-                            cgui::singleton().input_set(false);
+                            input_release();
                             return true;
                         } else {
                             ctx->ax._i = global_state.input_content[global_state.input_read_ptr];
@@ -2032,6 +3985,8 @@ namespace clib {
                             break;
                         }
                     } else {
+                        // 挂起直到键盘输入完成，再重新执行本中断
+                        wait_on(global_state.input_read_list);
                         ctx->pc -= INC_PTR;
                         return true;
                     }
@@ -2040,6 +3995,65 @@ namespace clib {
                 ctx->pc += INC_PTR;
                 return true;
             }
+            case 15: {
+                // 整块读取：仅输入重定向到管道时可用，返回读取的字节数，读完为0，未重定向为-1
+                auto va = (uint32_t) intr_arg(1);
+                auto n = intr_arg(0);
+                if (ctx->input_redirect == -1) {
+                    ctx->ax._i = -1;
+                } else if (n <= 0) {
+                    ctx->ax._i = 0;
+                } else if (ctx->input_pipe.size > 0) {
+                    ctx->ax._i = (int) pipe_out(ctx->input_pipe, va, (uint32_t) n);
+                    wake_all(ctx->input_pipe.writers);
+                } else if (!ctx->input_stop) {
+                    wait_on(ctx->input_pipe.readers);
+                    ctx->pc -= INC_PTR;
+                    return true;
+                } else {
+                    ctx->ax._i = 0;
+                }
+                break;
+            }
+            case 16: {
+                // 整块写入：返回写入的字节数，管道满时挂起，只写入部分时由调用者继续
+                auto va = (uint32_t) intr_arg(1);
+                auto n = intr_arg(0);
+                if (n <= 0) {
+                    ctx->ax._i = 0;
+                } else if (ctx->output_redirect != -1) {
+                    auto &p = tasks[ctx->output_redirect].input_pipe;
+                    if (p.closed) {
+                        ctx->ax._i = n;
+                    } else if (p.space() > 0) {
+                        ctx->ax._i = (int) pipe_in(p, va, (uint32_t) n);
+                        wake_all(p.readers);
+                    } else {
+                        wait_on(p.writers);
+                        ctx->pc -= INC_PTR;
+                        return true;
+                    }
+                } else if (global_state.input_lock == -1) {
+                    for (auto left = (uint32_t) n; left > 0;) {
+                        uint32_t size;
+                        auto s = vmm_page(va, size, false);
+                        size = std::min(size, left);
+                        for (uint32_t i = 0; i < size; ++i) {
+                            cgui::singleton().put_char((char) s[i]);
+                        }
+                        va += size;
+                        left -= size;
+                    }
+                    ctx->ax._i = n;
+                } else {
+                    if (global_state.input_lock != ctx->id)
+                        global_state.input_waiting_list.push_back(ctx->id);
+                    set_state(*ctx, CTS_WAIT);
+                    ctx->pc -= INC_PTR;
+                    return true;
+                }
+                break;
+            }
             case 20: {
                 if (global_state.input_lock == -1) {
                     set_resize_id = ctx->id;
@@ -2047,7 +4061,7 @@ namespace clib {
                 } else {
                     if (global_state.input_lock != ctx->id)
                         global_state.input_waiting_list.push_back(ctx->id);
-                    ctx->state = CTS_WAIT;
+                    set_state(*ctx, CTS_WAIT);
                     ctx->pc -= INC_PTR;
                     return true;
                 }
@@ -2060,6 +4074,9 @@ namespace clib {
             case 31:
                 ctx->ax._i = vmm_free((uint32_t) ctx->ax._i);
                 break;
+            case 32:
+                ctx->ax._i = vmm_realloc((uint32_t) intr_arg(1), (uint32_t) intr_arg(0));
+                break;
             case 40:
                 destroy(ctx->id);
                 return true;
@@ -2072,7 +4089,8 @@ namespace clib {
                 break;
             case 52: {
                 if (!ctx->child.empty()) {
-                    ctx->state = CTS_WAIT;
+                    ctx->waiting_child = true;
+                    set_state(*ctx, CTS_WAIT);
                     ctx->pc += INC_PTR;
                     return true;
                 } else {
@@ -2083,13 +4101,13 @@ namespace clib {
             case 53: {
                 ctx->ax._i = exec_file(vmm_getstr((uint32_t) ctx->ax._i));
                 if (ctx->ax._i >= 0 && ctx->ax._i < TASK_NUM)
-                    tasks[ctx->ax._i].state = CTS_WAIT;
+                    set_state(tasks[ctx->ax._i], CTS_WAIT);
                 break;
             }
             case 54: {
                 if (ctx->ax._i >= 0 && ctx->ax._i < TASK_NUM) {
                     if (ctx->child.find(ctx->ax._i) != ctx->child.end())
-                        tasks[ctx->ax._i].state = CTS_RUNNING;
+                        set_state(tasks[ctx->ax._i], CTS_RUNNING);
                 }
                 break;
             }
@@ -2186,6 +4204,7 @@ namespace clib {
             case 68: {
                 ctx->ax._i = fs.rm_safe(trim(vmm_getstr((uint32_t) ctx->ax._i)));
             }
+                break;
             case 69: {
                 auto h = ctx->ax._i >> 16;
                 auto c = (ctx->ax._i & 0xFFFF) - 0x1000;
@@ -2207,6 +4226,113 @@ namespace clib {
                 }
             }
                 break;
+            // 文件块读写：参数为句柄、缓冲区与长度，按页直接复制，返回字节数或错误码
+            case 71: {
+                auto h = intr_arg(2);
+                if (ctx->handles.find(h) != ctx->handles.end()) {
+                    auto dec = handles[h].data.file;
+                    auto va = (uint32_t) intr_arg(1);
+                    auto n = intr_arg(0);
+                    auto total = 0;
+                    while (n > 0) {
+                        uint32_t left;
+                        auto p = vmm_page(va, left, true);
+                        auto size = std::min((int) left, n);
+                        auto r = dec->read(p, size);
+                        if (r < 0) {
+                            if (total == 0)
+                                total = r;
+                            break;
+                        }
+                        total += r;
+                        if (r < size)
+                            break;
+                        va += r;
+                        n -= r;
+                    }
+                    ctx->ax._i = total;
+                } else {
+                    ctx->ax._i = -3;
+                }
+            }
+                break;
+            case 72: {
+                auto h = intr_arg(2);
+                if (ctx->handles.find(h) != ctx->handles.end()) {
+                    auto dec = handles[h].data.file;
+                    auto va = (uint32_t) intr_arg(1);
+                    auto n = intr_arg(0);
+                    auto total = 0;
+                    while (n > 0) {
+                        uint32_t left;
+                        auto p = vmm_page(va, left, false);
+                        auto r = dec->write(p, std::min((int) left, n));
+                        if (r <= 0) {
+                            if (r < 0 && total == 0)
+                                total = r;
+                            break;
+                        }
+                        total += r;
+                        va += r;
+                        n -= r;
+                    }
+                    ctx->ax._i = total;
+                } else {
+                    ctx->ax._i = -3;
+                }
+            }
+                break;
+            case 73: {
+                auto h = intr_arg(2);
+                if (ctx->handles.find(h) != ctx->handles.end()) {
+                    auto dec = handles[h].data.file;
+                    ctx->ax._i = dec->seek(intr_arg(1), intr_arg(0));
+                } else {
+                    ctx->ax._i = -3;
+                }
+            }
+                break;
+            case 74: {
+                auto h = intr_arg(1);
+                if (ctx->handles.find(h) != ctx->handles.end()) {
+                    ctx->ax._ui = vmm_mmap(handles[h].data.file, intr_arg(0) != 0);
+                } else {
+                    ctx->ax._i = 0;
+                }
+            }
+                break;
+            case 75:
+                ctx->ax._i = vmm_munmap(ctx->ax._ui);
+                break;
+            // 块内存与字符串操作，多个参数时ax为最后一个参数的地址
+            case 80: {
+                auto n = intr_arg(0);
+                if (n > 0)
+                    vmm_memmove((uint32_t) intr_arg(2), (uint32_t) intr_arg(1), (uint32_t) n);
+            }
+                break;
+            case 81: {
+                auto n = intr_arg(0);
+                if (n > 0)
+                    vmm_memset((uint32_t) intr_arg(2), (uint32_t) intr_arg(1), (uint32_t) n);
+            }
+                break;
+            case 82:
+                ctx->ax._ui = vmm_strlen(ctx->ax._ui);
+                break;
+            case 83: {
+                auto src = (uint32_t) intr_arg(0);
+                auto dst = (uint32_t) intr_arg(1);
+                vmm_memmove(dst, src, vmm_strlen(src) + 1);
+                ctx->ax._ui = dst;
+            }
+                break;
+            case 84:
+                ctx->ax._i = vmm_strcmp((uint32_t) intr_arg(1), (uint32_t) intr_arg(0));
+                break;
+            case 85:
+                ctx->ax._ui = vmm_strchr((uint32_t) intr_arg(1), intr_arg(0));
+                break;
             case 100: {
                 if (ctx->ax._i < 0) {
                     ctx->waiting_ms += (-ctx->ax._i) * 0.001;
@@ -2217,9 +4343,14 @@ namespace clib {
             }
                 break;
             case 101: {
-                auto now = std::chrono::high_resolution_clock::now();
-                if (std::chrono::duration_cast<std::chrono::duration<decimal>>(
-                    now - ctx->record_now).count() <= ctx->waiting_ms) {
+                // 未到期则挂起并登记唤醒时间，唤醒后重新执行本中断再检查一次
+                auto deadline = ctx->record_now + std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(
+                    std::chrono::duration<decimal>(ctx->waiting_ms));
+                ctx->sleeping = false;
+                if (std::chrono::high_resolution_clock::now() < deadline) {
+                    timers.push({deadline, ctx->id});
+                    ctx->sleeping = true;
+                    set_state(*ctx, CTS_WAIT);
                     ctx->pc -= INC_PTR;
                     return true;
                 }
@@ -2229,6 +4360,27 @@ namespace clib {
                 // 单位为微秒
                 ctx->ax._q = std::chrono::high_resolution_clock::now().time_since_epoch().count() / 1000;
                 break;
+            case 110: {
+                // 切换执行模式，参数为负时仅查询
+                auto mode = ctx->ax._i;
+                ctx->ax._i = global_state.exec_mode;
+                if (mode == EXEC_SWITCH || (mode == EXEC_THREADED && CVM_THREADED) ||
+                    (mode == EXEC_JIT && CVM_THREADED && CVM_JIT))
+                    global_state.exec_mode = (exec_mode_t) mode;
+            }
+                break;
+            case 111:
+                // 累计执行指令数，用于测速
+                ctx->ax._q = (int64) ins_total;
+                break;
+            case 112: {
+                // 设置优先级，参数越界时仅查询
+                auto priority = ctx->ax._i;
+                ctx->ax._i = ctx->priority;
+                if (priority >= 0 && priority < PRIORITY_NUM)
+                    ctx->priority = priority;
+            }
+                break;
             default:
 #if LOG_SYSTEM
                 printf("[SYSTEM] ERR  | unknown interrupt: %d\n", ctx->ax._i);
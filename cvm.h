@@ -9,13 +9,18 @@
 #include <memory>
 #include <vector>
 #include <unordered_set>
+#include <unordered_map>
 #include <chrono>
 #include <deque>
+#include <queue>
 #include "types.h"
 #include "memory.h"
 #include "cmem.h"
 #include "cvfs.h"
 #include "cnet.h"
+#include "cjit.h"
+#include "cpool.h"
+#include "cexception.h"
 
 namespace clib {
 
@@ -44,6 +49,7 @@ namespace clib {
 #define PDE_INDEX(x) (((x) >> 22) & 0x3ff)  // 获得地址对应的页目录号
 #define PTE_INDEX(x) (((x) >> 12) & 0x3ff)  // 获得页表号
 #define OFFSET_INDEX(x) ((x) & 0xfff)       // 获得页内偏移
+#define PAGE_FRAME(x) ((x) >> 12)           // 获得物理地址的页框号
 
 // 页目录项、页表项用uint32表示即可
     typedef uint32_t pde_t;
@@ -53,8 +59,6 @@ namespace clib {
 #define PDE_SIZE (PAGE_SIZE/sizeof(pte_t))
 /* 页表大小 1024 */
 #define PTE_SIZE (PAGE_SIZE/sizeof(pde_t))
-/* 页表总数 1024*PTE_SIZE*PAGE_SIZE = 4G */
-#define PTE_COUNT 1024
 
 /* CPU */
 #define CR0_PG  0x80000000
@@ -69,31 +73,68 @@ namespace clib {
 #define PTE_A   0x20    // 可访问 Accessed
 #define PTE_S   0x40    // Page size, 0 for 4kb pre page
 #define PTE_G   0x80    // Ignored
+#define PTE_C   0x200   // 写时复制 Copy on write（系统保留位）
 
+/* 文件映射区基址，映射按地址递增分配 */
+#define MMAP_BASE 0xb0000000
 /* 用户代码段基址 */
 #define USER_BASE 0xc0000000
 /* 用户数据段基址 */
 #define DATA_BASE 0xd0000000
 /* 用户栈基址 */
 #define STACK_BASE 0xe0000000
+/* 用户栈上限（含保护页），栈自顶向下按需映射 */
+#define STACK_LIMIT (256 * 1024)
+/* 栈底保护页，不映射，访问即栈溢出 */
+#define STACK_GUARD PAGE_SIZE
+/* 用户栈顶 */
+#define STACK_TOP (STACK_BASE + STACK_LIMIT)
 /* 用户堆基址 */
 #define HEAP_BASE 0xf0000000
 /* 段掩码 */
 #define SEGMENT_MASK 0x0fffffff
 
-/* 物理内存(单位：16B)，越多越好！ */
-#define PHY_MEM (256 * 1024)
+/* 物理页框数（64位宿主1GB，32位宿主256MB），宿主地址空间一次保留，页框首次使用时才提交 */
+#define PHY_PAGES (sizeof(void *) == 8 ? 256 * 1024 : 64 * 1024)
 
 #define PE_MAGIC "ccos"
 
-#define U2K(addr) ((uint) ((addr) << 20) & 0x0ff00000)
-#define K2U(addr) ((uint) ((addr) & 0x000fffff))
 
 #define TASK_NUM 256
+/* 优先级数，0最高；同一级内轮转 */
+#define PRIORITY_NUM 3
+#define PRIORITY_DEFAULT 1
+/* 时间片占cycle的百分比：前台（交互）与后台进程 */
+#define SLICE_FOREGROUND 100
+#define SLICE_BACKGROUND 50
 #define HANDLE_NUM 1024
 #define BIG_DATA_NUM 512
 
 #define READ_EOF 0x1000
+/* 管道缓冲区大小，写满时写者挂起 */
+#define PIPE_SIZE (64 * 1024)
+
+/* 软件TLB（直接映射），页标记低位存放读写权限 */
+#define TLB_SIZE 64
+#define TLB_INDEX(x) (((x) >> 12) & (TLB_SIZE - 1))
+#define TLB_R 0x1
+#define TLB_W 0x2
+
+/* GCC/Clang支持标签地址（computed goto），可直接线索化 */
+#if defined(__GNUC__)
+#define CVM_THREADED 1
+#else
+#define CVM_THREADED 0
+#endif
+
+/* 多个进程的用户态时间片并行执行（需线索化执行；MinGW的thread_local为模拟实现，开销过大） */
+#if CVM_THREADED && !defined(__MINGW32__)
+#define CVM_PARALLEL 1
+#else
+#define CVM_PARALLEL 0
+#endif
+/* 时间片不小于此值才并行，避免线程同步开销超过收益 */
+#define PARALLEL_MIN_CYCLE 10000
 
     class cvm : public imem, public vfs_func_t, public vfs_stream_call {
     public:
@@ -105,8 +146,10 @@ namespace clib {
 
         int load(const string_t &path, const std::vector<byte> &file, const std::vector<string_t> &args);
         bool run(int cycle, int &cycles);
+        // 键盘输入完成（回车或Ctrl-C），唤醒等待输入的进程
+        void input_wake();
 
-        void map_page(uint32_t addr, uint32_t id) override;
+        void unmap_page(uint32_t id) override;
         void as_root(bool flag);
         bool read_vfs(const string_t &path, std::vector<byte> &data) const;
         bool write_vfs(const string_t &path, const std::vector<byte> &data);
@@ -118,27 +161,58 @@ namespace clib {
         string_t stream_net(vfs_stream_t type, const string_t &path) override;
 
     private:
-        // 申请页框
-        uint32_t pmm_alloc(bool reusable = true);
+        // 申请页框，返回物理地址（页框号<<12）
+        uint32_t pmm_alloc();
+        // 释放当前进程对页框的引用
+        void pmm_free(uint32_t page);
+        // 物理地址转宿主地址
+        byte *pmm_addr(uint32_t pa) const;
         // 初始化页表
         void vmm_init();
         // 虚页映射
         void vmm_map(uint32_t va, uint32_t pa, uint32_t flags);
         // 解除映射
         void vmm_unmap(uint32_t va);
+        // 取得页目录dir中va所在的页表
+        pte_t *vmm_table(uint32_t dir, uint32_t va) const;
         // 查询分页情况
         int vmm_ismap(uint32_t va, uint32_t *pa) const;
+        pte_t *vmm_pte(uint32_t va) const;
+        // 写时复制：共享映射与写入时复制
+        void vmm_share(uint32_t dir);
+        uint32_t vmm_cow(uint32_t va);
+        // 缺页：栈自动向下扩展，堆按需映射
+        uint32_t vmm_fault(uint32_t va);
+        // 释放当前进程的全部映射
+        void vmm_release();
+        // 统计页目录dir中[begin, last]已映射的页数
+        uint32_t vmm_resident(uint32_t dir, uint32_t begin, uint32_t last) const;
+        // 刷新TLB
+        void tlb_flush();
+        void tlb_invalidate(uint32_t va);
 
         template<class T = int>
-        T vmm_get(uint32_t va) const;
-        string_t vmm_getstr(uint32_t va) const;
+        T vmm_get(uint32_t va);
+        string_t vmm_getstr(uint32_t va);
         template<class T = int>
         T vmm_set(uint32_t va, T);
         void vmm_setstr(uint32_t va, const string_t &str);
         uint32_t vmm_malloc(uint32_t size);
         uint32_t vmm_free(uint32_t addr);
+        uint32_t vmm_realloc(uint32_t addr, uint32_t size);
+        // 文件映射：把文件内容读入新页框并映射到文件映射区，返回地址，失败为零
+        uint32_t vmm_mmap(vfs_node_dec *dec, bool cow);
+        int vmm_munmap(uint32_t va);
+        // 块操作：按页拆分后直接读写宿主内存
+        byte *vmm_page(uint32_t va, uint32_t &left, bool write);
+        void vmm_read(uint32_t va, byte *data, uint32_t count);
+        void vmm_write(uint32_t va, const byte *data, uint32_t count);
         uint32_t vmm_memset(uint32_t va, uint32_t value, uint32_t count);
         uint32_t vmm_memcmp(uint32_t src, uint32_t dst, uint32_t count);
+        void vmm_memmove(uint32_t dst, uint32_t src, uint32_t count);
+        uint32_t vmm_strlen(uint32_t va);
+        int vmm_strcmp(uint32_t a, uint32_t b);
+        uint32_t vmm_strchr(uint32_t va, int c);
         template<class T = int>
         void vmm_pushstack(uint32_t &sp, T value);
         template<class T = int>
@@ -146,6 +220,34 @@ namespace clib {
 
         void error(const string_t &) const;
         void exec(int cycle, int &cycles);
+        bool exec_threaded(int cycle, int &cycles, const void *const **table = nullptr, bool user = false);
+        std::vector<bool> verify(const std::vector<byte> &file, std::vector<uint32_t> &text) const;
+        void check_pc(uint32_t pc) const;
+        void decode(const uint32_t *text, uint32_t size, std::vector<bool> &&boundary);
+        static uint64 image_hash(const uint32_t *text, uint32_t size);
+        static ins_t specialize(int op, int type);
+        static ins_t fuse(const uint32_t *text, uint32_t i, uint32_t size);
+        void profile(const uint32_t *text, uint32_t size);
+        bool jit_compile(uint32_t entry);
+        void aot_compile();
+        static jit_helper_t jit_resolve(int op, int arg);
+        static int jit_fail(cvm *vm, const cexception &e);
+        static int jit_load(void *p, int n);
+        static int jit_save(void *p, int n);
+        static int jit_push(void *p, int n);
+        static int jit_pop(void *p, int n);
+        static int jit_ent(void *p, int n);
+        static int jit_call(void *p, int ret);
+        static int jit_lev(void *p, int);
+        static int jit_case(void *p, int);
+        template<class T, class R, class F>
+        static int jit_binop(void *p, int);
+        template<class T, class R, class F>
+        static int jit_unop(void *p, int);
+        void load_ax(int n);
+        void save_ax(int n);
+        void push_ax(int n);
+        void pop_ax(int n);
         void destroy(int id);
         int exec_file(const string_t &path);
         int fork();
@@ -153,6 +255,7 @@ namespace clib {
         char *output_fmt(int id) const;
         int output(int id);
         bool interrupt();
+        int intr_arg(int i);
         bool math(int id);
         void cast();
 
@@ -168,15 +271,11 @@ namespace clib {
         void destroy_handle(int handle);
 
     private:
-        /* 内核页表 = PTE_SIZE*PAGE_SIZE */
-        pde_t *pgd_kern;
-        /* 内核页表内容 = PTE_COUNT*PTE_SIZE*PAGE_SIZE */
-        pde_t *pte_kern;
-        /* 物理内存(1 block=16B) */
-        memory_pool<PHY_MEM> memory;
-        /* 页表 */
-        pde_t *pgdir{nullptr};
+        /* 物理内存：页对齐的连续宿主内存，页表项中只存物理地址（页框号），页框0保留 */
+        byte *phy_mem{nullptr};
         int pids{0};
+        /* 虚拟机初始化耗时（微秒），崩溃重启时同样计入 */
+        uint64 boot_us{0};
 
         enum ctx_flag_t {
             CTX_VALID = 1 << 0,
@@ -194,14 +293,55 @@ namespace clib {
 
         static const char *state_string(ctx_state_t);
 
+        // 预解码指令：载入时由代码段生成，每个代码字对应一项
+        struct ins_dec_t {
+            const void *handler; // 处理例程地址（直接线索化）
+            int op; // 操作码
+            int arg1; // 操作数1
+            int arg2; // 操作数2
+        };
+
+        // 代码映像：预解码结果、调用计数与本地代码（内容相同的映像由所有进程共享）
+        struct image_t {
+            std::vector<uint32_t> text; // 原始代码字，缓存命中时比对
+            std::vector<uint32_t> pages; // 代码页框（映像持有一份引用，各进程共享映射）
+            std::vector<ins_dec_t> ins;
+            std::vector<bool> boundary; // 指令边界（校验时得出）
+            std::vector<std::atomic<int>> calls; // 函数入口调用次数（并行执行时共享）
+            std::unique_ptr<cjit> jit;
+            bool aot{false}; // 载入时已编译全部函数
+        };
+
+        struct tlb_t {
+            uint32_t tag; // 虚页地址|权限位
+            byte *page; // 物理页的宿主地址
+        };
+
+        // 管道：读端进程持有的有界环形缓冲区，读写按连续段整块复制
+        struct pipe_t {
+            std::vector<byte> buf; // 首次写入时申请
+            uint32_t head{0}; // 读位置
+            uint32_t size{0}; // 未读字节数
+            bool closed{false}; // 读端已退出，写入直接丢弃
+            std::deque<int> readers; // 等待数据的进程
+            std::deque<int> writers; // 等待空间的进程
+
+            uint32_t space() const { return PIPE_SIZE - size; }
+            uint32_t write(const byte *data, uint32_t n);
+            uint32_t read(byte *data, uint32_t n);
+            void reset();
+        };
+
         struct context_t {
             uint flag;
             int id;
             int parent;
             std::unordered_set<int> child;
             ctx_state_t state;
+            int priority;
+            bool queued; // 已在就绪队列中
             string_t path;
-            uint mask;
+            uint32_t pgdir; // 页目录的物理地址，各进程独立，页表按需申请
             uint entry;
             uint poolsize;
             uint stack;
@@ -228,23 +368,56 @@ namespace clib {
             uint sp;
             bool debug;
             std::vector<byte> file;
-            std::vector<uint32_t> allocation;
-            std::vector<uint32_t> data_mem;
-            std::vector<uint32_t> text_mem;
-            std::vector<uint32_t> stack_mem;
+            std::vector<uint32_t> stack_mem; // 自栈顶向下依次映射的页
+            std::shared_ptr<image_t> code;
+            std::array<tlb_t, TLB_SIZE> tlb;
+            uint64 tlb_hit;
+            uint64 tlb_miss;
             std::unique_ptr<cmem> pool;
+            uint32_t mmap_top; // 文件映射区已分配的末尾
+            std::map<uint32_t, uint32_t> mmaps; // 文件映射：起始地址 -> 页数
             // SYSTEM CALL
-            std::chrono::system_clock::time_point record_now;
+            std::chrono::high_resolution_clock::time_point record_now;
             decimal waiting_ms;
+            bool sleeping; // 在定时器堆中等待唤醒
+            bool waiting_child; // 在wait中等待子进程退出
             int input_redirect;
             int output_redirect;
             bool input_stop;
-            std::deque<char> input_queue;
+            pipe_t input_pipe;
             std::unordered_set<int> handles;
         };
+        void set_state(context_t &c, ctx_state_t state);
+        // 等待队列：进程挂起于队列，事件发生时由内核唤醒，不再重复执行中断轮询
+        void wait_on(std::deque<int> &q);
+        int wake_one(std::deque<int> &q);
+        void wake_all(std::deque<int> &q);
+        void input_release();
+        // 当前进程的虚拟内存与管道之间按页复制，返回复制的字节数
+        uint32_t pipe_in(pipe_t &p, uint32_t va, uint32_t n);
+        uint32_t pipe_out(pipe_t &p, uint32_t va, uint32_t n);
+        int slice(const context_t &c, int cycle) const;
+        void run_parallel(int cycle, int &cycles);
+        void wake_timers();
+
+#if CVM_PARALLEL
+        // 当前进程：每个执行线程各自一份
+        static thread_local context_t *ctx;
+#else
         context_t *ctx{nullptr};
+#endif
         int available_tasks{0};
         std::array<context_t, TASK_NUM> tasks;
+        // 就绪队列（每个优先级一个），状态改变时不立即移除，出队时再检查
+        std::array<std::deque<int>, PRIORITY_NUM> ready_queue;
+        // 睡眠进程按唤醒时间排列的最小堆，到期时置为就绪，不再轮询
+        struct timer_t {
+            std::chrono::high_resolution_clock::time_point deadline;
+            int id;
+
+            bool operator>(const timer_t &t) const { return deadline > t.deadline; }
+        };
+        std::priority_queue<timer_t, std::vector<timer_t>, std::greater<timer_t>> timers;
         cvfs fs;
         cnet net;
 
@@ -259,17 +432,45 @@ namespace clib {
         int available_handles{0};
         int set_cycle_id{-1};
         int set_resize_id{-1};
+#if CVM_PARALLEL
+        static thread_local std::unique_ptr<cexception> jit_fault;
+#else
+        std::unique_ptr<cexception> jit_fault;
+#endif
+        std::unique_ptr<cpool> workers;
+        // 页框引用计数（fork后父子进程共享，零为空闲），下标为页框号，只增长到用过的最高页框
+        // 写时复制、栈扩展可能在并行阶段发生，须加锁
+        std::vector<int> frame_refs;
+        std::vector<uint32_t> frame_free; // 空闲页框栈，分配与释放均为O(1)
+        std::mutex frame_lock;
+        // 映像缓存：按代码内容哈希查找，预编译的映像常驻
+        std::unordered_map<uint64, std::weak_ptr<image_t>> image_cache;
+        std::vector<std::shared_ptr<image_t>> image_pinned;
+        // 指令统计：静态的相邻指令组合次数，动态的执行条数与融合条数
+        std::unordered_map<uint32_t, uint64> ins_pairs;
+        std::unordered_map<uint32_t, uint64> ins_triples;
+        uint64 ins_total{0};
+        std::atomic<uint64> ins_fused{0};
         std::array<handle_t, HANDLE_NUM> handles;
 
     public:
+        enum exec_mode_t {
+            EXEC_SWITCH, // switch解释执行
+            EXEC_THREADED, // 预解码+直接线索化执行
+            EXEC_JIT, // 线索化执行，热点函数编译为本地代码
+        };
+
         static struct global_state_t {
             bool interrupt{false};
             int input_lock{-1};
-            std::vector<int> input_waiting_list;
+            std::deque<int> input_lock_list; // 等待输入锁，释放时直接交给队首
+            std::deque<int> input_waiting_list; // 输入期间被阻塞的输出，无人接手输入锁时全部唤醒
+            std::deque<int> input_read_list; // 持锁进程等待键盘输入完成
             std::string input_content;
             bool input_success{false};
             int input_read_ptr{-1};
             string_t hostname{"ccos"};
+            exec_mode_t exec_mode{CVM_THREADED ? (CVM_JIT ? EXEC_JIT : EXEC_THREADED) : EXEC_SWITCH};
         } global_state;
     };
 }
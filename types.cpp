@@ -302,10 +302,75 @@ namespace clib {
         std::make_tuple(NOT, "NOT"),
         std::make_tuple(LNT, "LNT"),
         std::make_tuple(EXIT, "EXIT"),
+        std::make_tuple(LEA_LOAD, "LEA_LOAD"),
+        std::make_tuple(LEA_PUSH, "LEA_PUSH"),
+        std::make_tuple(LOAD_PUSH, "LOAD_PUSH"),
+        std::make_tuple(IMM_PUSH, "IMM_PUSH"),
+        std::make_tuple(PUSH_IMM, "PUSH_IMM"),
+        std::make_tuple(PUSH_LEA, "PUSH_LEA"),
+        std::make_tuple(IMM_CALL, "IMM_CALL"),
+        std::make_tuple(LEA_LOAD_PUSH, "LEA_LOAD_PUSH"),
+        std::make_tuple(PUSH_LEA_LOAD, "PUSH_LEA_LOAD"),
+        std::make_tuple(PUSH_IMM_ADD, "PUSH_IMM_ADD"),
+        std::make_tuple(ADD_I32, "ADD_I32"),
+        std::make_tuple(ADD_I64, "ADD_I64"),
+        std::make_tuple(ADD_F32, "ADD_F32"),
+        std::make_tuple(ADD_F64, "ADD_F64"),
+        std::make_tuple(SUB_I32, "SUB_I32"),
+        std::make_tuple(SUB_I64, "SUB_I64"),
+        std::make_tuple(SUB_F32, "SUB_F32"),
+        std::make_tuple(SUB_F64, "SUB_F64"),
+        std::make_tuple(MUL_I32, "MUL_I32"),
+        std::make_tuple(MUL_I64, "MUL_I64"),
+        std::make_tuple(MUL_F32, "MUL_F32"),
+        std::make_tuple(MUL_F64, "MUL_F64"),
+        std::make_tuple(DIV_I32, "DIV_I32"),
+        std::make_tuple(DIV_I64, "DIV_I64"),
+        std::make_tuple(DIV_F32, "DIV_F32"),
+        std::make_tuple(DIV_F64, "DIV_F64"),
+        std::make_tuple(MOD_I32, "MOD_I32"),
+        std::make_tuple(OR_I32, "OR_I32"),
+        std::make_tuple(XOR_I32, "XOR_I32"),
+        std::make_tuple(AND_I32, "AND_I32"),
+        std::make_tuple(SHL_I32, "SHL_I32"),
+        std::make_tuple(SHR_I32, "SHR_I32"),
+        std::make_tuple(EQ_I32, "EQ_I32"),
+        std::make_tuple(EQ_F64, "EQ_F64"),
+        std::make_tuple(NE_I32, "NE_I32"),
+        std::make_tuple(NE_F64, "NE_F64"),
+        std::make_tuple(LT_I32, "LT_I32"),
+        std::make_tuple(LT_U32, "LT_U32"),
+        std::make_tuple(LT_F64, "LT_F64"),
+        std::make_tuple(GT_I32, "GT_I32"),
+        std::make_tuple(GT_U32, "GT_U32"),
+        std::make_tuple(GT_F64, "GT_F64"),
+        std::make_tuple(LE_I32, "LE_I32"),
+        std::make_tuple(LE_U32, "LE_U32"),
+        std::make_tuple(LE_F64, "LE_F64"),
+        std::make_tuple(GE_I32, "GE_I32"),
+        std::make_tuple(GE_U32, "GE_U32"),
+        std::make_tuple(GE_F64, "GE_F64"),
     };
 
     const string_t &ins_str(ins_t t) {
-        assert(t >= NOP && t <= EXIT);
+        assert(t >= NOP && t < INS_END);
         return std::get<1>(ins_string_list[t]);
     }
+
+    // 指令长度（含操作数，单位为字）
+    int ins_len(ins_t t) {
+        assert(t >= NOP && t <= EXIT);
+        switch (t) {
+            case NOP:
+            case CALL:
+            case LEV:
+            case CASE:
+            case EXIT:
+                return 1;
+            case IMX:
+                return 3;
+            default:
+                return 2;
+        }
+    }
 }
@@ -170,6 +170,16 @@ namespace clib {
         NOP, LEA, IMM, IMX, JMP, JZ, JNZ, ENT, LOAD, SAVE, INTR, CAST, ADJ, CALL, LEV,
         PUSH, POP, OR, XOR, AND, EQ, CASE, NE, LT, GT, LE, GE, SHL, SHR, ADD, SUB, MUL, DIV, MOD, NEG, NOT, LNT,
         EXIT,
+        // 超级指令（载入时由常见指令序列改写而来，不出现在目标文件中）
+        LEA_LOAD, LEA_PUSH, LOAD_PUSH, IMM_PUSH, PUSH_IMM, PUSH_LEA, IMM_CALL,
+        LEA_LOAD_PUSH, PUSH_LEA_LOAD, PUSH_IMM_ADD,
+        // 按类型特化的运算指令（载入时由运算指令及其类型操作数改写而来）
+        ADD_I32, ADD_I64, ADD_F32, ADD_F64, SUB_I32, SUB_I64, SUB_F32, SUB_F64,
+        MUL_I32, MUL_I64, MUL_F32, MUL_F64, DIV_I32, DIV_I64, DIV_F32, DIV_F64,
+        MOD_I32, OR_I32, XOR_I32, AND_I32, SHL_I32, SHR_I32, EQ_I32, EQ_F64,
+        NE_I32, NE_F64, LT_I32, LT_U32, LT_F64, GT_I32, GT_U32, GT_F64,
+        LE_I32, LE_U32, LE_F64, GE_I32, GE_U32, GE_F64,
+        INS_END,
     };
 
     template<lexer_t>
@@ -257,6 +267,8 @@ struct base_lexer_t<obj> \
 
     const string_t& ins_str(ins_t);
 #define INS_STRING(t) ins_str(t)
+    int ins_len(ins_t);
+#define INS_LEN(t) ins_len(t)
 
     enum coll_t {
         c_program,